@@ -0,0 +1,166 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ARENA_ALIGNMENT 16
+#define ALIGN_UP(n) (((n) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    ArenaBlock* prev; // large blocks only, so they can be unlinked
+    size_t size; // usable bytes after the header
+    size_t used;
+};
+
+#define BLOCK_HEADER ALIGN_UP(sizeof(ArenaBlock))
+
+static uint8_t* block_data(ArenaBlock* block) {
+    return (uint8_t*)block + BLOCK_HEADER;
+}
+
+static ArenaBlock* data_block(void* p) {
+    return (ArenaBlock*)((uint8_t*)p - BLOCK_HEADER);
+}
+
+// Allocations of more than a quarter block get their own block
+static int is_large(const Arena* arena, size_t size) {
+    return size > arena->block_size / 4;
+}
+
+// 0 = good, -1 = bad
+int arena_init(Arena* arena, size_t block_size) {
+    arena->blocks = NULL;
+    arena->large = NULL;
+    arena->block_size = block_size > 2 * BLOCK_HEADER ? block_size - BLOCK_HEADER : 4096;
+    return pthread_mutex_init(&arena->lock, NULL) == 0 ? 0 : -1;
+}
+
+static void free_blocks(ArenaBlock* block) {
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+// Frees everything allocated from the arena, which stays usable
+void arena_reset(Arena* arena) {
+    free_blocks(arena->blocks);
+    free_blocks(arena->large);
+    arena->blocks = NULL;
+    arena->large = NULL;
+}
+
+void arena_destroy(Arena* arena) {
+    arena_reset(arena);
+    pthread_mutex_destroy(&arena->lock);
+}
+
+static void link_large(Arena* arena, ArenaBlock* block) {
+    block->prev = NULL;
+    block->next = arena->large;
+    if (arena->large) arena->large->prev = block;
+    arena->large = block;
+}
+
+static void unlink_large(Arena* arena, ArenaBlock* block) {
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        arena->large = block->next;
+    }
+    if (block->next) block->next->prev = block->prev;
+}
+
+// 16-byte aligned memory that lives until it is freed or the arena is reset, NULL = out of memory
+void* arena_alloc(Arena* arena, size_t size) {
+    size = ALIGN_UP(size ? size : 1);
+    uint8_t* p = NULL;
+    pthread_mutex_lock(&arena->lock);
+
+    if (is_large(arena, size)) {
+        ArenaBlock* block = malloc(BLOCK_HEADER + size);
+        if (block) {
+            block->size = block->used = size;
+            link_large(arena, block);
+            p = block_data(block);
+        }
+    } else {
+        ArenaBlock* head = arena->blocks;
+        if (!head || head->size - head->used < size) {
+            head = malloc(BLOCK_HEADER + arena->block_size);
+            if (head) {
+                head->next = arena->blocks;
+                head->size = arena->block_size;
+                head->used = 0;
+                arena->blocks = head;
+            }
+        }
+        if (head) {
+            p = block_data(head) + head->used;
+            head->used += size;
+        }
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+    return p;
+}
+
+void* arena_calloc(Arena* arena, size_t size) {
+    void* p = arena_alloc(arena, size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+// Frees a large allocation right away, small ones are only reclaimed by arena_reset.
+// size must be the size p was allocated (or last reallocated) with
+void arena_free(Arena* arena, void* p, size_t size) {
+    if (!p || !is_large(arena, ALIGN_UP(size ? size : 1))) return;
+
+    pthread_mutex_lock(&arena->lock);
+    ArenaBlock* block = data_block(p);
+    unlink_large(arena, block);
+    pthread_mutex_unlock(&arena->lock);
+    free(block);
+}
+
+// Like realloc, for memory from arena_alloc of old_size bytes. NULL = out of memory,
+// p is left untouched then
+void* arena_realloc(Arena* arena, void* p, size_t old_size, size_t new_size) {
+    if (!p) return arena_alloc(arena, new_size);
+
+    size_t old_aligned = ALIGN_UP(old_size ? old_size : 1);
+    size_t new_aligned = ALIGN_UP(new_size ? new_size : 1);
+    if (is_large(arena, old_aligned) && is_large(arena, new_aligned)) {
+        // the block is out of the list while it is copied, so other threads aren't held up
+        ArenaBlock* block = data_block(p);
+        pthread_mutex_lock(&arena->lock);
+        unlink_large(arena, block);
+        pthread_mutex_unlock(&arena->lock);
+
+        ArenaBlock* grown = realloc(block, BLOCK_HEADER + new_aligned);
+        if (grown) {
+            grown->size = grown->used = new_aligned;
+            block = grown;
+        }
+
+        pthread_mutex_lock(&arena->lock);
+        link_large(arena, block);
+        pthread_mutex_unlock(&arena->lock);
+        return grown ? block_data(grown) : NULL;
+    }
+
+    void* moved = arena_alloc(arena, new_size);
+    if (!moved) return NULL;
+    memcpy(moved, p, old_size < new_size ? old_size : new_size);
+    arena_free(arena, p, old_size);
+    return moved;
+}
+
+char* arena_strdup(Arena* arena, const char* str) {
+    size_t len = strlen(str) + 1;
+    char* copy = arena_alloc(arena, len);
+    if (copy) memcpy(copy, str, len);
+    return copy;
+}
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Region allocator. Small allocations (channel structs, names, units) are carved out
+// of shared blocks and only go away all at once. Large ones (sample buffers) get a
+// block each, which can also be grown or freed on its own. Either way everything is
+// released together by arena_reset, so tearing a log down is a walk over a few blocks
+// instead of several frees per channel. Allocation takes a lock, channels may be
+// created and grown from worker threads.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock* blocks; // shared blocks, the one being filled first
+    ArenaBlock* large; // one block per large allocation
+    size_t block_size;
+    pthread_mutex_t lock;
+} Arena;
+
+int arena_init(Arena* arena, size_t block_size);
+void arena_destroy(Arena* arena);
+void arena_reset(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_calloc(Arena* arena, size_t size);
+void* arena_realloc(Arena* arena, void* p, size_t old_size, size_t new_size);
+void arena_free(Arena* arena, void* p, size_t size);
+char* arena_strdup(Arena* arena, const char* str);
+
+#endif
@@ -0,0 +1,651 @@
+#include "data_log.h"
+#include "csv_index.h"
+#include "number_parse.h"
+#include "motec_log.h"
+#include "ld_codec.h"
+#include "ldparser.h"
+#include "dbc_plan.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ROWS 100000
+#define DEFAULT_COLUMNS 50
+#define DEFAULT_RATE 100.0
+#define DEFAULT_RESAMPLE 20.0
+#define SIGNALS_PER_MESSAGE 4 // 16-bit signals filling an 8-byte frame
+#define DECODE_SAMPLE_COUNT (16u << 20)
+#define DECODE_REPEATS 8
+#define MAX_STAGES 32
+
+typedef struct BenchConfig {
+    size_t rows;
+    size_t columns;
+    double rate; // Hz the synthetic logs are sampled at
+    double missing; // fraction of CSV cells left empty and of CAN frames dropped
+    double quoted; // fraction of CSV cells holding quoted text with newlines in it
+    double resample; // Hz
+    int threads;
+    int json;
+} BenchConfig;
+
+// One timed stage, bytes and rows are what the stage consumed
+typedef struct StageResult {
+    const char* name;
+    double seconds;
+    size_t bytes;
+    size_t rows;
+    long peak_rss_kb; // high water mark while the stage ran
+    double checksum; // keeps the work observable, and should match between builds
+} StageResult;
+
+typedef struct Bench {
+    BenchConfig config;
+    StageResult stages[MAX_STAGES];
+    size_t stage_count;
+    double stage_start;
+} Bench;
+
+// Growable text the synthetic inputs are printed into
+typedef struct TextBuffer {
+    char* data;
+    size_t len;
+    size_t capacity;
+} TextBuffer;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Deterministic xorshift so every run parses the same text
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// 1 with probability fraction, from the low 32 bits of r
+static int is_missing(uint64_t r, double fraction) {
+    return (double)(r & 0xffffffffu) < fraction * 4294967296.0;
+}
+
+// Resets the RSS high water mark so every stage reports its own peak. Without
+// /proc/self/clear_refs (Linux 4.0+) the peak covers the run so far
+static void reset_peak_rss(void) {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (f) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
+
+static long peak_rss_kb(void) {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+        }
+        fclose(f);
+        if (kb >= 0) return kb;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void stage_begin(Bench* bench) {
+    reset_peak_rss();
+    bench->stage_start = now_seconds();
+}
+
+static void stage_end(Bench* bench, const char* name, size_t bytes, size_t rows, double checksum) {
+    double seconds = now_seconds() - bench->stage_start;
+    if (bench->stage_count >= MAX_STAGES) return;
+
+    StageResult* stage = &bench->stages[bench->stage_count++];
+    stage->name = name;
+    stage->seconds = seconds;
+    stage->bytes = bytes;
+    stage->rows = rows;
+    stage->peak_rss_kb = peak_rss_kb();
+    stage->checksum = checksum;
+}
+
+static int text_printf(TextBuffer* text, const char* format, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, format);
+        size_t room = text->capacity - text->len;
+        int written = vsnprintf(text->data + text->len, room, format, ap);
+        va_end(ap);
+        if (written < 0) return -1;
+        if ((size_t)written < room) {
+            text->len += (size_t)written;
+            return 0;
+        }
+
+        size_t capacity = text->capacity ? text->capacity * 2 : 1 << 16;
+        while (capacity - text->len <= (size_t)written) capacity *= 2;
+        char* data = realloc(text->data, capacity);
+        if (!data) return -1;
+        text->data = data;
+        text->capacity = capacity;
+    }
+}
+
+// Time plus config->columns channels, cells shaped like typical logger output: a slow
+// sine with noise, printed as integers, fixed or scientific notation
+static int make_csv(const BenchConfig* config, TextBuffer* text) {
+    static const char* units[] = {"rpm", "kPa", "C", "V", "%", "deg"};
+
+    int result = text_printf(text, "Time");
+    for (size_t c = 0; c < config->columns && result == 0; c++) {
+        result = text_printf(text, ",Channel %zu", c + 1);
+    }
+    if (result == 0) result = text_printf(text, "\ns");
+    for (size_t c = 0; c < config->columns && result == 0; c++) {
+        result = text_printf(text, ",%s", units[c % 6]);
+    }
+    if (result == 0) result = text_printf(text, "\n");
+
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t row = 0; row < config->rows && result == 0; row++) {
+        result = text_printf(text, "%.4f", (double)row / config->rate);
+        for (size_t c = 0; c < config->columns && result == 0; c++) {
+            uint64_t r = next_random(&state);
+            if (is_missing(r, config->missing)) {
+                result = text_printf(text, ",");
+                continue;
+            }
+            // looks like a row of its own to anything that splits on newlines without quotes
+            if (is_missing(r >> 32, config->quoted)) {
+                result = text_printf(text, ",\"x\n%zu.5,9999\n\"", row);
+                continue;
+            }
+            double value = 100.0 * sin((double)row * 0.001 * (double)(c + 1)) + (double)(r % 1000) / 1000.0;
+            switch (r >> 61) {
+                case 0: result = text_printf(text, ",%d", (int)value); break;
+                case 1: result = text_printf(text, ",%.6e", value); break;
+                case 2: result = text_printf(text, ",%.1f", value); break;
+                default: result = text_printf(text, ",%.3f", value); break;
+            }
+        }
+        if (result == 0) result = text_printf(text, "\n");
+    }
+    return result;
+}
+
+static size_t can_message_count(const BenchConfig* config) {
+    return (config->columns + SIGNALS_PER_MESSAGE - 1) / SIGNALS_PER_MESSAGE;
+}
+
+// One 8-byte message per SIGNALS_PER_MESSAGE columns, each signal a scaled signed 16-bit value
+static int make_dbc(const BenchConfig* config, TextBuffer* text) {
+    int result = text_printf(text, "VERSION \"\"\n\n");
+    for (size_t m = 0; m < can_message_count(config) && result == 0; m++) {
+        result = text_printf(text, "BO_ %zu MSG%zu: 8 Vector__XXX\n", 0x100 + m, m);
+        for (int s = 0; s < SIGNALS_PER_MESSAGE && result == 0; s++) {
+            result = text_printf(text, " SG_ Signal%zu_%d : %d|16@1- (0.01,0) [-327.68|327.67] \"V\" Vector__XXX\n",
+                                 m, s, s * 16);
+        }
+        if (result == 0) result = text_printf(text, "\n");
+    }
+    return result;
+}
+
+// A candump log with every message sent once per row, config->missing of the frames dropped
+static int make_candump(const BenchConfig* config, TextBuffer* text, size_t* frame_count) {
+    static const char hex[] = "0123456789ABCDEF";
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    int result = 0;
+    *frame_count = 0;
+    for (size_t row = 0; row < config->rows && result == 0; row++) {
+        double timestamp = 1600000000.0 + (double)row / config->rate;
+        for (size_t m = 0; m < can_message_count(config) && result == 0; m++) {
+            uint64_t r = next_random(&state);
+            if (is_missing(r, config->missing)) continue;
+
+            char data[17];
+            for (int i = 0; i < 16; i++) data[i] = hex[(r >> (i * 4)) & 0xf];
+            data[16] = '\0';
+            result = text_printf(text, "(%.6f) can0 %03zX#%s\n", timestamp, 0x100 + m, data);
+            (*frame_count)++;
+        }
+    }
+    return result;
+}
+
+// 1 if both logs hold the same channels with the same samples, bit for bit
+static int datalogs_match(DataLog* a, DataLog* b) {
+    if (a->channel_count != b->channel_count) return 0;
+    for (size_t i = 0; i < a->channel_count; i++) {
+        Channel* x = a->channels[i];
+        Channel* y = b->channels[i];
+        if (strcmp(x->name, y->name) != 0 || x->message_count != y->message_count ||
+            x->frequency != y->frequency) {
+            return 0;
+        }
+        size_t bytes = x->message_count * sizeof(double);
+        if (memcmp(x->values, y->values, bytes) != 0 ||
+            memcmp(x->time_base->timestamps, y->time_base->timestamps, bytes) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static double datalog_checksum(DataLog* log) {
+    double sum = 0.0;
+    for (size_t i = 0; i < log->channel_count; i++) {
+        Channel* channel = log->channels[i];
+        for (size_t s = 0; s < channel->message_count; s += 97) sum += channel_value(channel, s);
+    }
+    return sum;
+}
+
+static size_t datalog_value_bytes(DataLog* log) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < log->channel_count; i++) {
+        bytes += log->channels[i]->message_count * sizeof(double);
+    }
+    return bytes;
+}
+
+// Splits the CSV into rows and fields
+static void bench_tokenize(Bench* bench, const TextBuffer* csv) {
+    stage_begin(bench);
+    CsvScanner scanner;
+    size_t fields = 0;
+    if (csv_scanner_init(&scanner, csv->data, csv->len) == 0) {
+        size_t field_count;
+        while (csv_scanner_next_row(&scanner, &field_count)) fields += field_count;
+        csv_scanner_free(&scanner);
+    }
+    stage_end(bench, "tokenize", csv->len, bench->config.rows, (double)fields);
+}
+
+// Parses every CSV cell with parse_number and, for reference, strtod
+static int bench_number_parse(Bench* bench, const TextBuffer* csv) {
+    char* cells = malloc(csv->len + 1);
+    if (!cells) return -1;
+    for (size_t i = 0; i < csv->len; i++) {
+        char c = csv->data[i];
+        cells[i] = c == ',' || c == '\n' ? '\0' : c;
+    }
+    cells[csv->len] = '\0';
+    const char* end = cells + csv->len;
+
+    stage_begin(bench);
+    double sum = 0.0;
+    for (const char* p = cells; p < end; ) {
+        size_t len = strlen(p);
+        double value;
+        if (len > 0 && parse_number(p, p + len, &value) == len) sum += value;
+        p += len + 1;
+    }
+    stage_end(bench, "number_parse", csv->len, bench->config.rows, sum);
+
+    stage_begin(bench);
+    sum = 0.0;
+    for (const char* p = cells; p < end; ) {
+        size_t len = strlen(p);
+        if (len > 0) sum += strtod(p, NULL);
+        p += len + 1;
+    }
+    stage_end(bench, "strtod", csv->len, bench->config.rows, sum);
+
+    free(cells);
+    return 0;
+}
+
+// The conversion pipeline: parse the CSV, resample, build and write the .ld, read it back
+static int bench_pipeline(Bench* bench, const TextBuffer* csv) {
+    const BenchConfig* config = &bench->config;
+    FILE* f = tmpfile();
+    if (!f) return -1;
+    if (fwrite(csv->data, 1, csv->len, f) != csv->len) {
+        fclose(f);
+        return -1;
+    }
+    rewind(f);
+
+    DataLog* log = datalog_create("");
+    if (!log) {
+        fclose(f);
+        return -1;
+    }
+    stage_begin(bench);
+    int result = datalog_from_csv_log(log, f);
+    stage_end(bench, "datalog_from_csv_log", csv->len, config->rows, datalog_checksum(log));
+    fclose(f);
+
+    if (result == 0 && config->threads > 1) {
+        DataLog* threaded = datalog_create("");
+        if (!threaded) {
+            datalog_destroy(log);
+            return -1;
+        }
+        stage_begin(bench);
+        result = datalog_from_csv_buffer_threaded(threaded, csv->data, csv->len, config->threads);
+        stage_end(bench, "csv_parse_threaded", csv->len, config->rows, datalog_checksum(threaded));
+        // the threads must parse exactly the rows the single threaded scanner does
+        if (result == 0 && !datalogs_match(log, threaded)) {
+            printf("ERROR: Threaded CSV parse differs from the single threaded one\n");
+            result = -1;
+        }
+        datalog_destroy(threaded);
+    }
+
+    if (result == 0 && config->resample > 0) {
+        size_t bytes = datalog_value_bytes(log);
+        stage_begin(bench);
+        result = datalog_resample_with(log, config->resample, RESAMPLE_LINEAR, config->threads);
+        stage_end(bench, "resample", bytes, config->rows, datalog_checksum(log));
+    }
+
+    MotecLog* motec = result == 0 ? motec_log_create() : NULL;
+    if (!motec || motec_log_initialize(motec) != 0) {
+        motec_log_free(motec);
+        datalog_destroy(log);
+        return -1;
+    }
+    size_t rows = log->channel_count > 0 ? log->channels[0]->message_count : 0;
+    size_t bytes = datalog_value_bytes(log);
+    stage_begin(bench);
+    result = motec_log_add_all_channels(motec, log);
+    stage_end(bench, "motec_log_add_all_channels", bytes, rows, (double)motec->channel_count);
+
+    char path[] = "/tmp/benchmark_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) result = -1;
+    else close(fd);
+
+    struct stat st = {0};
+    if (result == 0) {
+        stage_begin(bench);
+        result = motec_log_write(motec, path);
+        if (result == 0) stat(path, &st);
+        stage_end(bench, "motec_log_write", (size_t)st.st_size, rows, (double)st.st_size);
+    }
+    motec_log_free(motec);
+    datalog_destroy(log);
+
+    if (result == 0) {
+        stage_begin(bench);
+        ldData* ld = read_ldfile(path);
+        double sum = 0.0;
+        if (ld) {
+            for (size_t i = 0; i < ld->chann_count; i++) {
+                const float* values = ld_channel_values(ld, i, 1);
+                if (values && ld->channs[i]->data_len > 0) sum += values[ld->channs[i]->data_len - 1];
+            }
+        } else {
+            result = -1;
+        }
+        stage_end(bench, "read_ldfile", (size_t)st.st_size, rows, sum);
+        free_lddata(ld);
+    }
+
+    if (fd >= 0) unlink(path);
+    return result;
+}
+
+// Decodes the candump log with the synthetic DBC, compiled outside the timing
+static int bench_can(Bench* bench) {
+    TextBuffer dbc_text = {0};
+    TextBuffer candump = {0};
+    size_t frames = 0;
+    if (make_dbc(&bench->config, &dbc_text) != 0 || make_candump(&bench->config, &candump, &frames) != 0) {
+        free(dbc_text.data);
+        free(candump.data);
+        return -1;
+    }
+
+    int result = -1;
+    DbcDatabase* dbc = dbc_parse(dbc_text.data, dbc_text.len);
+    DbcPlan* plan = dbc ? dbc_plan_compile(dbc, dbc_plan_hash(dbc_text.data, dbc_text.len)) : NULL;
+    DataLog* log = datalog_create("");
+    if (plan && log) {
+        stage_begin(bench);
+        result = datalog_from_can_buffer(log, candump.data, candump.len, plan);
+        stage_end(bench, "datalog_from_can_buffer", candump.len, frames, datalog_checksum(log));
+    }
+
+    datalog_destroy(log);
+    dbc_plan_free(plan);
+    dbc_free(dbc);
+    free(dbc_text.data);
+    free(candump.data);
+    return result;
+}
+
+// Plain per-sample loop with the dtype switch inside, what decoding cost before the kernels
+static void decode_reference(const void* raw, size_t count, const LdEncoding* encoding, float* out) {
+    const uint8_t* p = raw;
+    double factor = pow(10.0, -encoding->dec) / encoding->scale;
+    for (size_t i = 0; i < count; i++) {
+        double x;
+        switch (encoding->dtype) {
+            case DTYPE_INT16: { int16_t v; memcpy(&v, p + i * 2, 2); x = v; break; }
+            case DTYPE_INT32: { int32_t v; memcpy(&v, p + i * 4, 4); x = v; break; }
+            case DTYPE_FLOAT16: { uint16_t v; memcpy(&v, p + i * 2, 2); x = ld_half_to_float(v); break; }
+            default: { float v; memcpy(&v, p + i * 4, 4); x = v; break; }
+        }
+        out[i] = (float)((x * factor + encoding->shift) * encoding->mul);
+    }
+}
+
+static double decode_checksum(const float* out, size_t count) {
+    double checksum = 0.0;
+    for (size_t i = 0; i < count; i += 4099) checksum += out[i];
+    return checksum;
+}
+
+// Fills raw with count samples of dtype, values shaped like typical logger channels
+static void make_samples(uint8_t* raw, size_t count, uint16_t dtype) {
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t r = next_random(&state);
+        float value = (float)(r % 200000) / 1000.0f - 100.0f;
+        if (dtype == DTYPE_INT16) {
+            int16_t v = (int16_t)(r % 60000 - 30000);
+            memcpy(raw + i * 2, &v, 2);
+        } else if (dtype == DTYPE_INT32) {
+            int32_t v = (int32_t)(r % 2000000) - 1000000;
+            memcpy(raw + i * 4, &v, 4);
+        } else if (dtype == DTYPE_FLOAT16) {
+            uint16_t v = ld_float_to_half(value);
+            memcpy(raw + i * 2, &v, 2);
+        } else {
+            memcpy(raw + i * 4, &value, 4);
+        }
+    }
+}
+
+// Decodes a buffer of every dtype with the dispatched kernels and with a plain
+// loop. Integer dtypes are scaled the way ld_choose_encoding writes them
+static int bench_sample_decode(Bench* bench) {
+    static const struct { const char* kernel; const char* loop; LdEncoding encoding; } cases[] = {
+        {"ld_decode_int16", "ld_decode_int16_loop", {DTYPE_INT16, 40, 1, 1, 2}},
+        {"ld_decode_int32", "ld_decode_int32_loop", {DTYPE_INT32, -7, 1, 1, 3}},
+        {"ld_decode_float16", "ld_decode_float16_loop", {DTYPE_FLOAT16, 0, 1, 1, 0}},
+        {"ld_decode_float32", "ld_decode_float32_loop", {DTYPE_FLOAT32, 0, 2, 1, 0}},
+    };
+
+    size_t count = DECODE_SAMPLE_COUNT;
+    uint8_t* raw = malloc(count * 4);
+    float* out = malloc(count * sizeof(float));
+    if (!raw || !out) {
+        free(raw);
+        free(out);
+        return -1;
+    }
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const LdEncoding* encoding = &cases[c].encoding;
+        size_t raw_bytes = count * ld_sample_size(encoding->dtype);
+        make_samples(raw, count, encoding->dtype);
+
+        stage_begin(bench);
+        for (int r = 0; r < DECODE_REPEATS; r++) ld_decode_samples(raw, count, encoding, out);
+        stage_end(bench, cases[c].kernel, raw_bytes * DECODE_REPEATS, count * DECODE_REPEATS,
+                  decode_checksum(out, count));
+
+        stage_begin(bench);
+        for (int r = 0; r < DECODE_REPEATS; r++) decode_reference(raw, count, encoding, out);
+        stage_end(bench, cases[c].loop, raw_bytes * DECODE_REPEATS, count * DECODE_REPEATS,
+                  decode_checksum(out, count));
+    }
+
+    free(raw);
+    free(out);
+    return 0;
+}
+
+static double stage_mb_per_second(const StageResult* stage) {
+    return stage->seconds > 0 ? (double)stage->bytes / stage->seconds / 1e6 : 0.0;
+}
+
+static double stage_rows_per_second(const StageResult* stage) {
+    return stage->seconds > 0 ? (double)stage->rows / stage->seconds : 0.0;
+}
+
+static void print_table(const Bench* bench) {
+    const BenchConfig* config = &bench->config;
+    printf("%zu rows x %zu columns at %.1f Hz, %.1f%% missing, %.1f%% quoted, %d threads\n\n",
+           config->rows, config->columns, config->rate, config->missing * 100.0, config->quoted * 100.0,
+           config->threads);
+    printf("%-28s %10s %14s %12s %10s\n", "stage", "MB/s", "rows/s", "peak RSS MB", "seconds");
+    for (size_t i = 0; i < bench->stage_count; i++) {
+        const StageResult* stage = &bench->stages[i];
+        printf("%-28s %10.1f %14.0f %12.1f %10.4f\n", stage->name, stage_mb_per_second(stage),
+               stage_rows_per_second(stage), stage->peak_rss_kb / 1024.0, stage->seconds);
+    }
+}
+
+static void print_json(const Bench* bench) {
+    const BenchConfig* config = &bench->config;
+    printf("{\n  \"config\": {\"rows\": %zu, \"columns\": %zu, \"rate\": %g, \"missing\": %g, "
+           "\"quoted\": %g, \"resample\": %g, \"threads\": %d},\n",
+           config->rows, config->columns, config->rate, config->missing, config->quoted, config->resample,
+           config->threads);
+    printf("  \"stages\": [\n");
+    for (size_t i = 0; i < bench->stage_count; i++) {
+        const StageResult* stage = &bench->stages[i];
+        printf("    {\"name\": \"%s\", \"seconds\": %.6f, \"bytes\": %zu, \"rows\": %zu, "
+               "\"mb_per_s\": %.3f, \"rows_per_s\": %.1f, \"peak_rss_kb\": %ld, \"checksum\": %.17g}%s\n",
+               stage->name, stage->seconds, stage->bytes, stage->rows, stage_mb_per_second(stage),
+               stage_rows_per_second(stage), stage->peak_rss_kb, stage->checksum,
+               i + 1 < bench->stage_count ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+static void print_usage(void) {
+    printf("Usage: benchmark [options]\n\n");
+    printf("Options:\n");
+    printf("  --rows <n>         Rows of the synthetic logs (default %d)\n", DEFAULT_ROWS);
+    printf("  --columns <n>      Channels of the synthetic logs (default %d)\n", DEFAULT_COLUMNS);
+    printf("  --rate <hz>        Sample rate of the synthetic logs (default %.0f)\n", DEFAULT_RATE);
+    printf("  --missing <f>      Fraction of empty CSV cells and dropped CAN frames (default 0)\n");
+    printf("  --quoted <f>       Fraction of CSV cells holding quoted text with newlines (default 0)\n");
+    printf("  --resample <hz>    Resampling frequency, 0 skips the stage (default %.0f)\n", DEFAULT_RESAMPLE);
+    printf("  --threads <n>      Threads for the threaded stages (default 1)\n");
+    printf("  --json             Print the results as JSON\n");
+}
+
+static int parse_arguments(int argc, char** argv, BenchConfig* config) {
+    config->rows = DEFAULT_ROWS;
+    config->columns = DEFAULT_COLUMNS;
+    config->rate = DEFAULT_RATE;
+    config->missing = 0.0;
+    config->quoted = 0.0;
+    config->resample = DEFAULT_RESAMPLE;
+    config->threads = 1;
+    config->json = 0;
+
+    static struct option long_options[] = {
+        {"rows", required_argument, 0, 'r'},
+        {"columns", required_argument, 0, 'c'},
+        {"rate", required_argument, 0, 'f'},
+        {"missing", required_argument, 0, 'm'},
+        {"quoted", required_argument, 0, 'q'},
+        {"resample", required_argument, 0, 's'},
+        {"threads", required_argument, 0, 't'},
+        {"json", no_argument, 0, 'j'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:c:f:m:q:s:t:j", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r': config->rows = strtoull(optarg, NULL, 10); break;
+            case 'c': config->columns = strtoull(optarg, NULL, 10); break;
+            case 'f': config->rate = atof(optarg); break;
+            case 'm': config->missing = atof(optarg); break;
+            case 'q': config->quoted = atof(optarg); break;
+            case 's': config->resample = atof(optarg); break;
+            case 't': config->threads = atoi(optarg); break;
+            case 'j': config->json = 1; break;
+            default: return -1;
+        }
+    }
+
+    if (optind < argc || config->rows == 0 || config->columns == 0 || config->rate <= 0 ||
+        config->missing < 0 || config->missing > 1 ||
+        config->quoted < 0 || config->quoted > 1 || config->resample < 0 || config->threads < 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Bench bench;
+    memset(&bench, 0, sizeof(bench));
+    if (parse_arguments(argc, argv, &bench.config) != 0) {
+        print_usage();
+        return 1;
+    }
+
+    TextBuffer csv = {0};
+    if (make_csv(&bench.config, &csv) != 0) {
+        printf("ERROR: Cannot generate the synthetic CSV\n");
+        return 1;
+    }
+
+    int result = 0;
+    bench_tokenize(&bench, &csv);
+    if (bench_number_parse(&bench, &csv) != 0) result = -1;
+    if (result == 0 && bench_pipeline(&bench, &csv) != 0) result = -1;
+    free(csv.data);
+    if (result == 0 && bench_can(&bench) != 0) result = -1;
+    if (result == 0 && bench_sample_decode(&bench) != 0) result = -1;
+
+    if (result != 0) {
+        printf("ERROR: A stage failed\n");
+        return 1;
+    }
+
+    if (bench.config.json) {
+        print_json(&bench);
+    } else {
+        print_table(&bench);
+    }
+    return 0;
+}
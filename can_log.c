@@ -0,0 +1,438 @@
+#include "can_log.h"
+#include "dbc_plan.h"
+#include "data_log.h"
+#include "mapped_file.h"
+#include "stats.h"
+
+#define MAX_STANDARD_ID 0x7FF
+#define MAX_EXTENDED_ID 0x1FFFFFFF
+#define MIN_TABLE_SIZE 16
+#define MAX_FRACTION_DIGITS 9
+
+static const double FRACTION_SCALE[MAX_FRACTION_DIGITS + 1] = {
+    1e0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9
+};
+
+// Hex digit values with HEX_VALID set, 0 for every other byte. Payload bytes are random
+// so a table beats comparisons that branch on digit versus letter
+#define HEX_VALID 0x10
+static const uint8_t HEX_DIGITS[256] = {
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+    ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+    ['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c, ['D'] = 0x1d, ['E'] = 0x1e, ['F'] = 0x1f,
+    ['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c, ['d'] = 0x1d, ['e'] = 0x1e, ['f'] = 0x1f,
+};
+
+static inline int hex_value(unsigned char c) {
+    return HEX_DIGITS[c] ? HEX_DIGITS[c] & 0xf : -1;
+}
+
+static inline int is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// "seconds.fraction" as candump prints it, returns the first byte after the number
+static const char* parse_timestamp(const char* p, const char* end, double* timestamp) {
+    const char* start = p;
+    uint64_t seconds = 0;
+    while (p < end && (unsigned)(*p - '0') < 10u) seconds = seconds * 10 + (uint64_t)(*p++ - '0');
+    if (p == start) return NULL;
+
+    uint64_t fraction = 0;
+    int digits = 0;
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && (unsigned)(*p - '0') < 10u; p++) {
+            if (digits < MAX_FRACTION_DIGITS) {
+                fraction = fraction * 10 + (uint64_t)(*p - '0');
+                digits++;
+            }
+        }
+    }
+
+    *timestamp = (double)seconds + (double)fraction * FRACTION_SCALE[digits];
+    return p;
+}
+
+// Parses one log line in [p, end) into frame, 0 if it holds no usable data frame.
+// Only the bytes past the new length that the previous frame wrote are cleared
+static int parse_line(const char* p, const char* end, CanFrame* frame) {
+    while (p < end && is_blank(*p)) p++;
+    if (p >= end || *p != '(') return 0;
+
+    double timestamp;
+    p = parse_timestamp(p + 1, end, &timestamp);
+    if (!p || p >= end || *p != ')') return 0;
+    p++;
+
+    // interface name
+    while (p < end && is_blank(*p)) p++;
+    while (p < end && !is_blank(*p)) p++;
+    while (p < end && is_blank(*p)) p++;
+
+    uint32_t id = 0;
+    int digits = 0;
+    int h;
+    while (p < end && (h = hex_value((unsigned char)*p)) >= 0) {
+        id = (id << 4) | (uint32_t)h;
+        digits++;
+        p++;
+    }
+    if (digits == 0 || digits > 8 || p >= end || *p != '#') return 0;
+    p++;
+
+    // three digit IDs are standard frames, eight digit ones extended (error frames have bit 29 set)
+    if (digits > 3) {
+        if (id > MAX_EXTENDED_ID) return 0;
+        id |= CAN_EXTENDED_FLAG;
+    } else if (id > MAX_STANDARD_ID) {
+        return 0;
+    }
+
+    if (p < end && *p == '#') {
+        // CAN FD, one flags nibble before the data
+        if (p + 1 >= end || hex_value((unsigned char)p[1]) < 0) return 0;
+        p += 2;
+    } else if (p < end && (*p == 'R' || *p == 'r')) {
+        return 0;
+    }
+
+    unsigned length = 0;
+    while (p + 1 < end && length < CAN_MAX_DATA) {
+        unsigned hi = HEX_DIGITS[(unsigned char)p[0]];
+        unsigned lo = HEX_DIGITS[(unsigned char)p[1]];
+        if (!(hi & lo & HEX_VALID)) break;
+        frame->data[length++] = (uint8_t)((hi << 4) | (lo & 0xf));
+        p += 2;
+    }
+
+    if (length < frame->length) memset(frame->data + length, 0, frame->length - length);
+    frame->length = (uint8_t)length;
+    frame->id = id;
+    frame->timestamp = timestamp;
+    return 1;
+}
+
+void can_scanner_init(CanScanner* scanner, const char* data, size_t len) {
+    memset(scanner, 0, sizeof(CanScanner));
+    scanner->data = data;
+    scanner->len = len;
+}
+
+// Returns the next data frame of the log, NULL at the end. The frame is overwritten by the next call
+const CanFrame* can_scanner_next(CanScanner* scanner) {
+    while (scanner->offset < scanner->len) {
+        const char* line = scanner->data + scanner->offset;
+        const char* eol = memchr(line, '\n', scanner->len - scanner->offset);
+        const char* end = eol ? eol : scanner->data + scanner->len;
+        scanner->offset = (size_t)(end - scanner->data) + 1;
+
+        if (parse_line(line, end, &scanner->frame)) return &scanner->frame;
+    }
+    return NULL;
+}
+
+#define CAN_BATCH_FRAMES 256
+
+// Frames of one message waiting to be decoded together
+typedef struct CanBatch {
+    size_t count;
+    unsigned min_length; // shortest payload in the batch
+    double timestamps[CAN_BATCH_FRAMES];
+    uint8_t lengths[CAN_BATCH_FRAMES];
+    uint8_t payloads[CAN_BATCH_FRAMES * CAN_PAYLOAD_SIZE];
+} CanBatch;
+
+// Everything known about one DBC message while its frames are read
+typedef struct CanSlot {
+    uint32_t id;
+    const DbcMessagePlan* message; // NULL marks an empty slot
+    TimeBase* frames; // timestamp of every frame, shared by the message's channels
+    Channel** channels; // one per signal, created on the message's first frame
+    CanBatch* batch;
+} CanSlot;
+
+// Open addressing table from CAN ID to slot, sized to at most half full so a miss
+// (an ID the DBC doesn't know) ends at an empty slot after a probe or two
+typedef struct CanTable {
+    CanSlot* slots;
+    uint32_t mask;
+    int shift;
+} CanTable;
+
+// Per-log decoding state
+typedef struct CanDecoder {
+    const DbcPlan* plan;
+    CanTable table;
+    Channel** merged; // channels fed by more than one message, sorted by time at the end
+    size_t merged_count;
+    double values[CAN_BATCH_FRAMES];
+    double timestamps[CAN_BATCH_FRAMES];
+    uint64_t mux[CAN_BATCH_FRAMES];
+} CanDecoder;
+
+static inline uint32_t can_table_index(const CanTable* table, uint32_t id) {
+    return (id * 0x9E3779B1u) >> table->shift;
+}
+
+static int can_table_init(CanTable* table, const DbcPlan* plan) {
+    uint32_t size = MIN_TABLE_SIZE;
+    int bits = 4;
+    while (size < plan->message_count * 2) {
+        size <<= 1;
+        bits++;
+    }
+
+    table->slots = calloc(size, sizeof(CanSlot));
+    if (!table->slots) return -1;
+    table->mask = size - 1;
+    table->shift = 32 - bits;
+
+    for (size_t i = 0; i < plan->message_count; i++) {
+        const DbcMessagePlan* message = &plan->messages[i];
+        uint32_t index = can_table_index(table, message->id);
+        while (table->slots[index].message && table->slots[index].id != message->id) {
+            index = (index + 1) & table->mask;
+        }
+        // the first definition of a duplicated ID wins
+        if (table->slots[index].message) continue;
+
+        table->slots[index].id = message->id;
+        table->slots[index].message = message;
+    }
+    return 0;
+}
+
+static inline CanSlot* can_table_find(const CanTable* table, uint32_t id) {
+    uint32_t index = can_table_index(table, id);
+    for (;;) {
+        CanSlot* slot = &table->slots[index];
+        if (!slot->message) return NULL;
+        if (slot->id == id) return slot;
+        index = (index + 1) & table->mask;
+    }
+}
+
+static void can_table_free(CanTable* table) {
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        time_base_release(table->slots[i].frames);
+        free(table->slots[i].channels);
+        free(table->slots[i].batch);
+    }
+    free(table->slots);
+}
+
+static int add_merged_channel(CanDecoder* decoder, Channel* channel) {
+    for (size_t i = 0; i < decoder->merged_count; i++) {
+        if (decoder->merged[i] == channel) return 0;
+    }
+    Channel** merged = realloc(decoder->merged, sizeof(Channel*) * (decoder->merged_count + 1));
+    if (!merged) return -1;
+    decoder->merged = merged;
+    decoder->merged[decoder->merged_count++] = channel;
+    return 0;
+}
+
+// Creates the channels of a message the first time one of its frames shows up. Signals
+// with the same name in different messages feed one channel, like the python version
+static int create_message_channels(CanDecoder* decoder, DataLog* log, CanSlot* slot) {
+    const DbcMessagePlan* message = slot->message;
+    slot->frames = time_base_create(1000);
+    slot->channels = calloc(message->signal_count ? message->signal_count : 1, sizeof(Channel*));
+    slot->batch = malloc(sizeof(CanBatch));
+    if (!slot->frames || !slot->channels || !slot->batch) return -1;
+    slot->batch->count = 0;
+    slot->batch->min_length = CAN_MAX_DATA;
+
+    for (size_t i = 0; i < message->signal_count; i++) {
+        const DbcSignalPlan* signal = &decoder->plan->signals[message->first_signal + i];
+        const char* name = dbc_plan_string(decoder->plan, signal->name);
+        Channel* channel = datalog_find_channel(log, name);
+        if (channel) {
+            if (add_merged_channel(decoder, channel) != 0) return -1;
+        } else {
+            channel = datalog_create_channel(log, name, dbc_plan_string(decoder->plan, signal->unit),
+                                             signal->decimals, 1000);
+            if (!channel) return -1;
+            channel_set_time_base(channel, slot->frames);
+        }
+        slot->channels[i] = channel;
+    }
+    return 0;
+}
+
+// Decodes every frame queued for a message, one signal at a time across the whole batch,
+// and appends the results to the signal channels. 0 = good, -1 = bad
+static int flush_batch(CanDecoder* decoder, CanSlot* slot) {
+    CanBatch* batch = slot->batch;
+    size_t count = batch->count;
+    if (count == 0) return 0;
+
+    // frame times go in first, so channels that share them only copy values
+    for (size_t i = 0; i < count; i++) {
+        if (time_base_append(slot->frames, batch->timestamps[i]) != 0) return -1;
+    }
+
+    const DbcMessagePlan* message = slot->message;
+    const DbcSignalPlan* signals = decoder->plan->signals + message->first_signal;
+    const DbcSignalPlan* multiplexor = message->multiplexor >= 0 ? &decoder->plan->signals[message->multiplexor] : NULL;
+    if (multiplexor) {
+        for (size_t i = 0; i < count; i++) {
+            decoder->mux[i] = batch->lengths[i] >= multiplexor->end_byte
+                ? dbc_plan_raw(multiplexor, batch->payloads + i * CAN_PAYLOAD_SIZE)
+                : ~(uint64_t)0;
+        }
+    }
+
+    for (size_t s = 0; s < message->signal_count; s++) {
+        const DbcSignalPlan* signal = &signals[s];
+        dbc_plan_decode(signal, batch->payloads, count, decoder->values);
+
+        const double* timestamps = batch->timestamps;
+        size_t kept = count;
+        int multiplexed = signal->mux_type == DBC_SIGNAL_MULTIPLEXED;
+        if (multiplexed || signal->end_byte > batch->min_length) {
+            // only frames that carry the signal, and select it if it is multiplexed
+            kept = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (batch->lengths[i] < signal->end_byte) continue;
+                if (multiplexed && (!multiplexor || decoder->mux[i] != signal->mux_value)) continue;
+                decoder->timestamps[kept] = batch->timestamps[i];
+                decoder->values[kept++] = decoder->values[i];
+            }
+            timestamps = decoder->timestamps;
+        }
+
+        if (kept > 0 && channel_append_many(slot->channels[s], timestamps, decoder->values, kept) != 0) {
+            return -1;
+        }
+    }
+
+    batch->count = 0;
+    batch->min_length = CAN_MAX_DATA;
+    return 0;
+}
+
+static int queue_frame(CanDecoder* decoder, CanSlot* slot, const CanFrame* frame) {
+    CanBatch* batch = slot->batch;
+    size_t i = batch->count++;
+    batch->timestamps[i] = frame->timestamp;
+    batch->lengths[i] = frame->length;
+    if (frame->length < batch->min_length) batch->min_length = frame->length;
+    memcpy(batch->payloads + i * CAN_PAYLOAD_SIZE, frame->data, CAN_PAYLOAD_SIZE);
+
+    return batch->count == CAN_BATCH_FRAMES ? flush_batch(decoder, slot) : 0;
+}
+
+typedef struct TimedValue {
+    double timestamp;
+    double value;
+    size_t order;
+} TimedValue;
+
+static int compare_timed_values(const void* a, const void* b) {
+    const TimedValue* x = a;
+    const TimedValue* y = b;
+    if (x->timestamp != y->timestamp) return x->timestamp < y->timestamp ? -1 : 1;
+    return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+// Batches of different messages are flushed at different times, so a channel fed by
+// several messages is put back in time order. 0 = good, -1 = bad
+static int sort_channel_by_time(Channel* channel) {
+    size_t count = channel->message_count;
+    if (__atomic_load_n(&channel->time_base->refs, __ATOMIC_ACQUIRE) > 1) return 0;
+
+    const double* timestamps = channel->time_base->timestamps;
+    size_t i = 1;
+    while (i < count && timestamps[i - 1] <= timestamps[i]) i++;
+    if (i >= count) return 0;
+
+    TimedValue* pairs = malloc(sizeof(TimedValue) * count);
+    if (!pairs) return -1;
+    for (i = 0; i < count; i++) {
+        pairs[i].timestamp = timestamps[i];
+        pairs[i].value = channel->values[i];
+        pairs[i].order = i;
+    }
+    qsort(pairs, count, sizeof(TimedValue), compare_timed_values);
+    for (i = 0; i < count; i++) {
+        channel->time_base->timestamps[i] = pairs[i].timestamp;
+        channel->values[i] = pairs[i].value;
+    }
+    free(pairs);
+    return 0;
+}
+
+// candump log parsing over an in-memory buffer. Every frame whose ID is in the plan is
+// queued per message and decoded in batches into one channel per signal, frames of
+// other IDs are skipped. 0 = good, -1 = bad
+int datalog_from_can_buffer(DataLog* log, const char* data, size_t len, const DbcPlan* plan) {
+    if (!log || !plan || (!data && len > 0)) return -1;
+
+    CanDecoder* decoder = calloc(1, sizeof(CanDecoder));
+    if (!decoder) return -1;
+    decoder->plan = plan;
+    if (can_table_init(&decoder->table, plan) != 0) {
+        free(decoder);
+        return -1;
+    }
+
+    size_t first_channel = log->channel_count;
+    CanScanner scanner;
+    can_scanner_init(&scanner, data, len);
+
+    int result = 0;
+    const CanFrame* frame;
+    while (result == 0 && (frame = can_scanner_next(&scanner)) != NULL) {
+        CanSlot* slot = can_table_find(&decoder->table, frame->id);
+        if (!slot) continue;
+
+        if (!slot->channels && create_message_channels(decoder, log, slot) != 0) {
+            result = -1;
+            break;
+        }
+        result = queue_frame(decoder, slot, frame);
+    }
+
+    for (uint32_t i = 0; i <= decoder->table.mask && result == 0; i++) {
+        if (decoder->table.slots[i].batch) result = flush_batch(decoder, &decoder->table.slots[i]);
+    }
+    for (size_t i = 0; i < decoder->merged_count && result == 0; i++) {
+        result = sort_channel_by_time(decoder->merged[i]);
+    }
+#ifndef MOTEC_NO_STATS
+    for (uint32_t i = 0; i <= decoder->table.mask; i++) {
+        if (decoder->table.slots[i].frames) STATS_ADD(STAT_ROWS, decoder->table.slots[i].frames->count);
+    }
+    for (size_t i = first_channel; i < log->channel_count; i++) {
+        STATS_ADD(STAT_CELLS, log->channels[i]->message_count);
+    }
+#endif
+
+    can_table_free(&decoder->table);
+    free(decoder->merged);
+    free(decoder);
+
+    for (size_t i = first_channel; i < log->channel_count; i++) {
+        log->channels[i]->frequency = channel_avg_frequency(log->channels[i]);
+    }
+    return result;
+}
+
+// candump log parsing from a stream, used when the input can't be mapped (pipes). 0 = good, -1 = bad
+int datalog_from_can_log(DataLog* log, FILE* f, const char* dbc_path) {
+    DbcPlan* plan = dbc_plan_load(dbc_path);
+    if (!plan) return -1;
+
+    MappedFile input;
+    if (mapped_file_read_stream(&input, f) != 0) {
+        dbc_plan_free(plan);
+        return -1;
+    }
+
+    int result = datalog_from_can_buffer(log, input.data, input.size, plan);
+    mapped_file_close(&input);
+    dbc_plan_free(plan);
+    return result;
+}
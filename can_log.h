@@ -0,0 +1,29 @@
+#ifndef CAN_LOG_H
+#define CAN_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dbc.h"
+
+// One frame of a candump log
+typedef struct CanFrame {
+    double timestamp;
+    uint32_t id; // CAN_EXTENDED_FLAG set for 29-bit IDs
+    uint8_t length;
+    uint8_t data[CAN_PAYLOAD_SIZE]; // zero past length
+} CanFrame;
+
+// Walks the frames of a 'candump -l' log held in memory, "(timestamp) iface ID#DATA"
+// per line, CAN FD frames as "ID##<flags>DATA". Lines are parsed in place without
+// allocating; remote, error and malformed lines are skipped.
+typedef struct CanScanner {
+    const char* data;
+    size_t len;
+    size_t offset; // start of the next line
+    CanFrame frame; // the frame most recently returned
+} CanScanner;
+
+void can_scanner_init(CanScanner* scanner, const char* data, size_t len);
+const CanFrame* can_scanner_next(CanScanner* scanner);
+
+#endif
@@ -0,0 +1,357 @@
+#include "csv_index.h"
+#include "number_parse.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CSV_INDEX_X86 1
+#endif
+
+#define CSV_BLOCK_SIZE 64
+#define INITIAL_FIELD_CAPACITY 64
+
+// Bitmasks of the structural characters in one 64-byte block, bit i = byte i
+typedef struct BlockMasks {
+    uint64_t commas;
+    uint64_t quotes;
+    uint64_t newlines;
+} BlockMasks;
+
+typedef void (*classify_fn)(const char* block, BlockMasks* masks);
+
+#if !defined(CSV_INDEX_X86) || !defined(__SSE2__)
+static void classify_scalar(const char* block, BlockMasks* masks) {
+    uint64_t commas = 0, quotes = 0, newlines = 0;
+    for (int i = 0; i < CSV_BLOCK_SIZE; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (block[i]) {
+            case ',': commas |= bit; break;
+            case '"': quotes |= bit; break;
+            case '\n': newlines |= bit; break;
+        }
+    }
+    masks->commas = commas;
+    masks->quotes = quotes;
+    masks->newlines = newlines;
+}
+#endif
+
+#if defined(CSV_INDEX_X86) && defined(__SSE2__)
+static uint64_t movemask_sse2(__m128i a, __m128i b, __m128i c, __m128i d, __m128i needle) {
+    uint64_t m0 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, needle));
+    uint64_t m1 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b, needle));
+    uint64_t m2 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, needle));
+    uint64_t m3 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(d, needle));
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+static void classify_sse2(const char* block, BlockMasks* masks) {
+    __m128i a = _mm_loadu_si128((const __m128i*)block);
+    __m128i b = _mm_loadu_si128((const __m128i*)(block + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(block + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(block + 48));
+    masks->commas = movemask_sse2(a, b, c, d, _mm_set1_epi8(','));
+    masks->quotes = movemask_sse2(a, b, c, d, _mm_set1_epi8('"'));
+    masks->newlines = movemask_sse2(a, b, c, d, _mm_set1_epi8('\n'));
+}
+#endif
+
+#if defined(CSV_INDEX_X86)
+__attribute__((target("avx2")))
+static uint64_t movemask_avx2(__m256i lo, __m256i hi, __m256i needle) {
+    uint64_t m0 = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle));
+    uint64_t m1 = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle));
+    return m0 | (m1 << 32);
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char* block, BlockMasks* masks) {
+    __m256i lo = _mm256_loadu_si256((const __m256i*)block);
+    __m256i hi = _mm256_loadu_si256((const __m256i*)(block + 32));
+    masks->commas = movemask_avx2(lo, hi, _mm256_set1_epi8(','));
+    masks->quotes = movemask_avx2(lo, hi, _mm256_set1_epi8('"'));
+    masks->newlines = movemask_avx2(lo, hi, _mm256_set1_epi8('\n'));
+}
+#endif
+
+// Picks the widest classifier this CPU supports
+static classify_fn select_classifier(void) {
+#if defined(CSV_INDEX_X86)
+    if (__builtin_cpu_supports("avx2")) return classify_avx2;
+#endif
+#if defined(CSV_INDEX_X86) && defined(__SSE2__)
+    return classify_sse2;
+#else
+    return classify_scalar;
+#endif
+}
+
+// Bit i of the result is the xor of bits 0..i of x
+static uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static classify_fn get_classifier(void) {
+    // scanners on several threads may all pick the classifier, they store the same one
+    static classify_fn selected = NULL;
+    classify_fn classify = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+    if (!classify) {
+        classify = select_classifier();
+        __atomic_store_n(&selected, classify, __ATOMIC_RELAXED);
+    }
+    return classify;
+}
+
+// Loads the block at scanner->block and returns its unquoted commas and newlines
+static uint64_t index_block(CsvScanner* scanner) {
+    classify_fn classify = get_classifier();
+
+    const char* block = scanner->data + scanner->block;
+    char tail[CSV_BLOCK_SIZE];
+
+    // the last partial block is padded with zeros so the vector loads stay in bounds
+    size_t remaining = scanner->len - scanner->block;
+    if (remaining < CSV_BLOCK_SIZE) {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, block, remaining);
+        block = tail;
+    }
+
+    BlockMasks masks;
+    classify(block, &masks);
+
+    uint64_t in_quotes = prefix_xor(masks.quotes) ^ scanner->quote_carry;
+    scanner->quote_carry = (uint64_t)((int64_t)in_quotes >> 63);
+
+    return (masks.commas | masks.newlines) & ~in_quotes;
+}
+
+// Number of rows csv_scanner_next_row would return for the buffer, counted from the
+// unquoted newlines without indexing any fields. Lets callers size buffers up front
+size_t csv_count_rows(const char* data, size_t len) {
+    classify_fn classify = get_classifier();
+    uint64_t quote_carry = 0;
+    size_t rows = 0;
+    size_t offset = 0;
+
+    for (; offset + CSV_BLOCK_SIZE <= len; offset += CSV_BLOCK_SIZE) {
+        BlockMasks masks;
+        classify(data + offset, &masks);
+        uint64_t in_quotes = prefix_xor(masks.quotes) ^ quote_carry;
+        quote_carry = (uint64_t)((int64_t)in_quotes >> 63);
+        rows += (size_t)__builtin_popcountll(masks.newlines & ~in_quotes);
+    }
+
+    if (offset < len) {
+        char tail[CSV_BLOCK_SIZE];
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, data + offset, len - offset);
+        BlockMasks masks;
+        classify(tail, &masks);
+        uint64_t in_quotes = prefix_xor(masks.quotes) ^ quote_carry;
+        rows += (size_t)__builtin_popcountll(masks.newlines & ~in_quotes);
+    }
+
+    // last line has no trailing newline
+    if (len > 0 && data[len - 1] != '\n') rows++;
+    return rows;
+}
+
+// Moves each of the ascending offsets to the start of the row after the first unquoted
+// newline at or past it, len when there is none. Newlines inside quoted cells are
+// skipped just like csv_scanner_next_row skips them, in one pass over the buffer for
+// every offset, so a buffer split at the results splits on the scanner's own rows
+void csv_align_rows(const char* data, size_t len, size_t* offsets, size_t count) {
+    classify_fn classify = get_classifier();
+    uint64_t quote_carry = 0;
+    size_t next = 0;
+
+    for (size_t offset = 0; offset < len && next < count; offset += CSV_BLOCK_SIZE) {
+        BlockMasks masks;
+        if (offset + CSV_BLOCK_SIZE <= len) {
+            classify(data + offset, &masks);
+        } else {
+            char tail[CSV_BLOCK_SIZE];
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, data + offset, len - offset);
+            classify(tail, &masks);
+        }
+        uint64_t in_quotes = prefix_xor(masks.quotes) ^ quote_carry;
+        quote_carry = (uint64_t)((int64_t)in_quotes >> 63);
+        uint64_t newlines = masks.newlines & ~in_quotes;
+
+        // several offsets can land in one block, each takes the first newline from its position
+        while (next < count && offsets[next] < offset + CSV_BLOCK_SIZE) {
+            uint64_t from = offsets[next] > offset ? newlines >> (offsets[next] - offset) << (offsets[next] - offset)
+                                                   : newlines;
+            if (!from) break;
+            offsets[next++] = offset + (size_t)__builtin_ctzll(from) + 1;
+        }
+    }
+    for (; next < count; next++) offsets[next] = len;
+}
+
+// Length of the buffer up to and including its last unquoted newline, 0 if no row is
+// complete yet. Lets a reader of a growing file leave a partly written row for later
+size_t csv_complete_len(const char* data, size_t len) {
+    classify_fn classify = get_classifier();
+    uint64_t quote_carry = 0;
+    size_t complete = 0;
+    size_t offset = 0;
+
+    for (; offset < len; offset += CSV_BLOCK_SIZE) {
+        BlockMasks masks;
+        if (offset + CSV_BLOCK_SIZE <= len) {
+            classify(data + offset, &masks);
+        } else {
+            char tail[CSV_BLOCK_SIZE];
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, data + offset, len - offset);
+            classify(tail, &masks);
+        }
+        uint64_t in_quotes = prefix_xor(masks.quotes) ^ quote_carry;
+        quote_carry = (uint64_t)((int64_t)in_quotes >> 63);
+        uint64_t newlines = masks.newlines & ~in_quotes;
+        if (newlines) complete = offset + (size_t)(64 - __builtin_clzll(newlines));
+    }
+    return complete;
+}
+
+// Appends [start, end) to the field index of the current row, 0 = good, -1 = bad
+static int push_field(CsvScanner* scanner, size_t* count, size_t start, size_t end) {
+    if (*count >= scanner->field_capacity) {
+        size_t new_capacity = scanner->field_capacity * 2;
+        CsvField* fields = realloc(scanner->fields, sizeof(CsvField) * new_capacity);
+        if (!fields) return -1;
+        scanner->fields = fields;
+        scanner->field_capacity = new_capacity;
+    }
+
+    scanner->fields[*count].ptr = scanner->data + start;
+    scanner->fields[*count].len = end - start;
+    (*count)++;
+    return 0;
+}
+
+// Drops a '\r' left on the last field by CRLF line endings
+static void strip_carriage_return(CsvScanner* scanner, size_t count) {
+    CsvField* last = &scanner->fields[count - 1];
+    if (last->len > 0 && last->ptr[last->len - 1] == '\r') last->len--;
+}
+
+// Prepares scanner to walk data, 0 = good, -1 = bad
+int csv_scanner_init(CsvScanner* scanner, const char* data, size_t len) {
+    memset(scanner, 0, sizeof(CsvScanner));
+    scanner->data = data;
+    scanner->len = len;
+
+    scanner->field_capacity = INITIAL_FIELD_CAPACITY;
+    scanner->fields = malloc(sizeof(CsvField) * scanner->field_capacity);
+    if (!scanner->fields) return -1;
+
+    if (len > 0) scanner->bits = index_block(scanner);
+    return 0;
+}
+
+// Indexes the next row into scanner->fields. Returns 1 if a row was found, 0 at the end of the buffer
+int csv_scanner_next_row(CsvScanner* scanner, size_t* field_count) {
+    size_t count = 0;
+
+    for (;;) {
+        while (scanner->bits == 0) {
+            scanner->block += CSV_BLOCK_SIZE;
+            if (scanner->block >= scanner->len) {
+                // last line has no trailing newline
+                if (count == 0 && scanner->field_start >= scanner->len) return 0;
+                if (push_field(scanner, &count, scanner->field_start, scanner->len) != 0) return 0;
+                scanner->field_start = scanner->len;
+                scanner->block = scanner->len;
+                strip_carriage_return(scanner, count);
+                *field_count = count;
+                return 1;
+            }
+            scanner->bits = index_block(scanner);
+        }
+
+        size_t pos = scanner->block + (size_t)__builtin_ctzll(scanner->bits);
+        scanner->bits &= scanner->bits - 1;
+
+        if (push_field(scanner, &count, scanner->field_start, pos) != 0) return 0;
+        scanner->field_start = pos + 1;
+
+        if (scanner->data[pos] == '\n') {
+            strip_carriage_return(scanner, count);
+            *field_count = count;
+            return 1;
+        }
+    }
+}
+
+// Offset of the first byte that hasn't been returned in a row yet
+size_t csv_scanner_offset(const CsvScanner* scanner) {
+    return scanner->field_start;
+}
+
+void csv_scanner_free(CsvScanner* scanner) {
+    free(scanner->fields);
+    scanner->fields = NULL;
+    scanner->field_capacity = 0;
+}
+
+// Strips surrounding whitespace and one pair of surrounding quotes
+void csv_field_trim(CsvField* field) {
+    const char* p = field->ptr;
+    size_t len = field->len;
+
+    while (len > 0 && isspace((unsigned char)*p)) {
+        p++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char)p[len - 1])) len--;
+
+    if (len >= 2 && p[0] == '"' && p[len - 1] == '"') {
+        p++;
+        len -= 2;
+    }
+
+    field->ptr = p;
+    field->len = len;
+}
+
+// Returns a trimmed, unquoted, NUL terminated copy of field ("" inside quotes becomes ")
+char* csv_field_dup(const CsvField* field) {
+    CsvField trimmed = *field;
+    csv_field_trim(&trimmed);
+    int quoted = trimmed.ptr > field->ptr && trimmed.ptr[-1] == '"';
+
+    char* result = malloc(trimmed.len + 1);
+    if (!result) return NULL;
+
+    size_t out = 0;
+    for (size_t i = 0; i < trimmed.len; i++) {
+        result[out++] = trimmed.ptr[i];
+        if (quoted && trimmed.ptr[i] == '"' && i + 1 < trimmed.len && trimmed.ptr[i + 1] == '"') i++;
+    }
+    result[out] = '\0';
+    return result;
+}
+
+// Parses a numeric cell. Returns 1 if it holds a value, 0 if it is empty, nan or not numeric
+int csv_field_parse_number(CsvField field, double* value) {
+    csv_field_trim(&field);
+    if (field.len == 0) return 0;
+
+    if (parse_number(field.ptr, field.ptr + field.len, value) != field.len) return 0;
+
+    // nan is a missing sample, +/-inf is kept as a value
+    return !isnan(*value);
+}
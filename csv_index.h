@@ -0,0 +1,40 @@
+#ifndef CSV_INDEX_H
+#define CSV_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One cell of a CSV row, pointing into the scanned buffer (not NUL terminated)
+typedef struct CsvField {
+    const char* ptr;
+    size_t len;
+} CsvField;
+
+// Splits a buffer into rows and fields. Delimiters, quotes and newlines are
+// located 64 bytes at a time with SIMD compares, commas and newlines inside
+// quoted fields are masked out, and each row is returned as an index of its
+// fields. Empty fields are kept so every cell stays in its own column.
+typedef struct CsvScanner {
+    const char* data;
+    size_t len;
+    size_t block;          // offset of the 64-byte block that bits belongs to
+    uint64_t bits;         // unconsumed comma/newline positions in that block
+    uint64_t quote_carry;  // all ones when the previous block ended inside quotes
+    size_t field_start;    // offset where the next field begins
+    CsvField* fields;      // field index of the row most recently returned
+    size_t field_capacity;
+} CsvScanner;
+
+int csv_scanner_init(CsvScanner* scanner, const char* data, size_t len);
+int csv_scanner_next_row(CsvScanner* scanner, size_t* field_count);
+size_t csv_scanner_offset(const CsvScanner* scanner);
+void csv_scanner_free(CsvScanner* scanner);
+size_t csv_count_rows(const char* data, size_t len);
+void csv_align_rows(const char* data, size_t len, size_t* offsets, size_t count);
+size_t csv_complete_len(const char* data, size_t len);
+
+void csv_field_trim(CsvField* field);
+char* csv_field_dup(const CsvField* field);
+int csv_field_parse_number(CsvField field, double* value);
+
+#endif
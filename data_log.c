@@ -1,18 +1,14 @@
 #include "data_log.h"
+#include "mapped_file.h"
+#include "csv_index.h"
+#include "parallel.h"
+#include "stats.h"
 #include <ctype.h>
 
-#define MAX_LINE_LENGTH 10000
-#define MAX_COLUMNS 1000
-#define INITIAL_CHANNEL_CAPACITY 500
-
-// Checks if string represents valid numeric value. Returns 1 if it is numeric, 0 otherwise
-int is_numeric(const char* str) {
-    if (!str || !*str) return 0;  
-    // printf("Debug - Checking if numeric: '%s'\n", str); // Debug
-    char* endptr;
-    strtod(str, &endptr);
-    return *endptr == '\0' || isspace((unsigned char)*endptr);
-}
+#define INITIAL_CHANNEL_CAPACITY 64
+#define ARENA_BLOCK_SIZE (64 << 10)
+#define MIN_CHUNK_BYTES (1 << 20) // smaller CSV bodies aren't worth another thread
+#define ACCESSPORT_INFO_PREFIX "AP Info"
 
 // Creates new DataLog structure, return null if memory allocation not working
 DataLog* datalog_create(const char* name) {
@@ -23,108 +19,343 @@ DataLog* datalog_create(const char* name) {
     log->channel_capacity = INITIAL_CHANNEL_CAPACITY;
     log->channel_count = 0;
     log->channels = (Channel**)malloc(sizeof(Channel*) * log->channel_capacity);
+    log->channel_index = NULL;
+    log->index_capacity = 0;
+    if (!log->name || !log->channels || arena_init(&log->arena, ARENA_BLOCK_SIZE) != 0) {
+        free(log->channels);
+        free(log->name);
+        free(log);
+        return NULL;
+    }
     
     return log;
 }
 
-// Removes all channels from DataLog
+// Removes all channels from DataLog. Channels from the log's arena only drop their time
+// base, their memory goes with the arena in one go
 void datalog_clear(DataLog* log) {
     for (size_t i = 0; i < log->channel_count; i++) {
-        channel_destroy(log->channels[i]);
+        Channel* channel = log->channels[i];
+        if (channel->arena == &log->arena) {
+            time_base_release(channel->time_base);
+        } else {
+            channel_destroy(channel);
+        }
     }
     log->channel_count = 0;
+    if (log->channel_index) memset(log->channel_index, 0, sizeof(Channel*) * log->index_capacity);
+    arena_reset(&log->arena);
 }
 
 // Completeley frees a DataLog and all of the channels
 void datalog_destroy(DataLog* log) {
     if (log) {
         datalog_clear(log);
+        arena_destroy(&log->arena);
+        free(log->channel_index);
         free(log->channels);
         free(log->name);
         free(log);
     }
 }
 
-// CSV parsing, 0 = good, -1 = bad
-int datalog_from_csv_log(DataLog* log, FILE* f) {
-    if (!f) return -1;
-    
-    char line[MAX_LINE_LENGTH];
-    char* header = NULL;
-    char* units = NULL;
-    
-    if (fgets(line, MAX_LINE_LENGTH, f)) {
-        header = strdup(line);
-        // printf("Debug - Header line: %s\n", header);
+// Rows of one byte range of the CSV body, parsed into thread-local channels before they are merged
+typedef struct CsvChunk {
+    const char* begin;
+    const char* end;
+    TimeBase* rows; // timestamp of every row in the range, shared by the chunk's channels
+    Channel** channels;
+    size_t channel_count;
+    int failed;
+} CsvChunk;
+
+typedef struct CsvMergeJob {
+    DataLog* log;
+    TimeBase* rows;
+    CsvChunk* chunks;
+    size_t chunk_count;
+    int failed; // set by any worker, always through __atomic_store_n
+} CsvMergeJob;
+
+#ifndef MOTEC_NO_STATS
+// Samples held by the channels, for the cells counter
+static size_t count_cells(Channel** channels, size_t channel_count) {
+    size_t cells = 0;
+    for (size_t i = 0; i < channel_count; i++) cells += channels[i]->message_count;
+    return cells;
+}
+#endif
+
+// Capacity for needed elements, at least double the current one so rows appended a few
+// at a time (--follow) don't copy everything on every append
+static size_t grow_capacity(size_t capacity, size_t needed) {
+    if (needed <= capacity) return capacity;
+    return needed > capacity * 2 ? needed : capacity * 2;
+}
+
+// Sizes the chunk's row timestamps and channel values for every row in its range, so
+// they are allocated once instead of doubling their way up. 0 = good, -1 = bad
+static int reserve_csv_rows(CsvChunk* chunk) {
+    size_t rows = csv_count_rows(chunk->begin, (size_t)(chunk->end - chunk->begin));
+    TimeBase* time_base = chunk->rows;
+    if (time_base_reserve(time_base, grow_capacity(time_base->capacity, time_base->count + rows)) != 0) {
+        return -1;
     }
-    if (fgets(line, MAX_LINE_LENGTH, f)) {
-        units = strdup(line);
-        // printf("Debug - Units line: %s\n", units);
+    for (size_t i = 0; i < chunk->channel_count; i++) {
+        Channel* channel = chunk->channels[i];
+        size_t capacity = grow_capacity(channel->message_capacity, channel->message_count + rows);
+        if (channel_reserve(channel, capacity) != 0) return -1;
     }
+    return 0;
+}
 
-    char** headers = malloc(MAX_COLUMNS * sizeof(char*));
-    char** unit_tokens = malloc(MAX_COLUMNS * sizeof(char*));
-    int column_count = 0;
-    
-    char* token = strtok(header, ",");
-    while (token && column_count < MAX_COLUMNS) {
-        headers[column_count] = strdup(token);
-        trim_whitespace(headers[column_count]);
-        column_count++;
-        token = strtok(NULL, ",");
+// Parses every row in [chunk->begin, chunk->end) into chunk->channels
+static void parse_csv_chunk(CsvChunk* chunk) {
+#ifndef MOTEC_NO_STATS
+    // the chunk can extend rows parsed earlier, only the new ones are counted
+    size_t first_row = chunk->rows->count;
+    size_t first_cells = count_cells(chunk->channels, chunk->channel_count);
+#endif
+    CsvScanner scanner;
+    if (reserve_csv_rows(chunk) != 0 ||
+        csv_scanner_init(&scanner, chunk->begin, (size_t)(chunk->end - chunk->begin)) != 0) {
+        chunk->failed = 1;
+        return;
     }
-    
-    int unit_count = 0;
-    token = strtok(units, ",");
-    while (token && unit_count < column_count) {
-        unit_tokens[unit_count] = strdup(token);
-        trim_whitespace(unit_tokens[unit_count]);
-        // printf("Debug - Column %d (%s): unit='%s'\n", 
-        //        unit_count, headers[unit_count], unit_tokens[unit_count]);
-        unit_count++;
-        token = strtok(NULL, ",");
-    }
-
-    for (int i = 1; i < column_count && i < unit_count; i++) {
-        if (headers[i] && unit_tokens[i]) {
-            Channel* channel = channel_create(headers[i], unit_tokens[i], 3, 1000);
-            if (channel) {
-                log->channels[log->channel_count++] = channel;
+
+    size_t field_count;
+    while (csv_scanner_next_row(&scanner, &field_count)) {
+        const CsvField* fields = scanner.fields;
+
+        double timestamp;
+        if (!csv_field_parse_number(fields[0], &timestamp)) continue;
+
+        if (time_base_append(chunk->rows, timestamp) != 0) {
+            chunk->failed = 1;
+            break;
+        }
+
+        // field i + 1 always belongs to channel i, empty cells are just skipped
+        size_t cells = field_count - 1 < chunk->channel_count ? field_count - 1 : chunk->channel_count;
+        for (size_t i = 0; i < cells; i++) {
+            double value;
+            if (csv_field_parse_number(fields[i + 1], &value) &&
+                channel_append(chunk->channels[i], timestamp, value) != 0) {
+                chunk->failed = 1;
             }
         }
     }
+    csv_scanner_free(&scanner);
 
-    double first_timestamp = -1;
-    double last_timestamp = 0;
-    
-    while (fgets(line, MAX_LINE_LENGTH, f)) {
-        char* value_str = strtok(line, ",");
-        if (!value_str || !is_numeric(value_str)) continue;
-        
-        double timestamp = atof(value_str);
-        if (first_timestamp < 0) first_timestamp = timestamp;
-        last_timestamp = timestamp;
-        
-        for (size_t i = 0; i < log->channel_count; i++) {
-            value_str = strtok(NULL, ",");
-            if (value_str && is_numeric(value_str)) {
-                double value = atof(value_str);
-                Channel* channel = log->channels[i];
-                
-                // trivial, should have enough, this should never run
-                if (channel->message_count >= channel->message_capacity) {
-                    channel->message_capacity *= 2;
-                    channel->messages = realloc(channel->messages, 
-                        channel->message_capacity * sizeof(Message));
-                }
-                
-                channel->messages[channel->message_count].timestamp = timestamp;
-                channel->messages[channel->message_count].value = value;
-                channel->message_count++;
+    STATS_ADD(STAT_ROWS, chunk->rows->count - first_row);
+    STATS_ADD(STAT_CELLS, count_cells(chunk->channels, chunk->channel_count) - first_cells);
+}
+
+static void parse_csv_chunk_task(void* context, size_t index) {
+    parse_csv_chunk(&((CsvChunk*)context)[index]);
+}
+
+// Concatenates channel index's values from every chunk, in file order. A channel that
+// has a value on every row up to its last one keeps sharing the merged row timestamps
+static void merge_csv_channel_task(void* context, size_t index) {
+    CsvMergeJob* job = (CsvMergeJob*)context;
+    Channel* channel = job->log->channels[index];
+
+    size_t total = 0;
+    size_t rows_before = 0;
+    int follows_rows = 1;
+    for (size_t c = 0; c < job->chunk_count; c++) {
+        Channel* part = job->chunks[c].channels[index];
+        if (part->message_count > 0 &&
+            (part->time_base != job->chunks[c].rows || total != rows_before)) {
+            follows_rows = 0;
+        }
+        total += part->message_count;
+        rows_before += job->chunks[c].rows->count;
+    }
+
+    if (channel_reserve(channel, total) != 0) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    TimeBase* time_base = job->rows;
+    if (!follows_rows) {
+        time_base = time_base_create(total);
+        if (!time_base) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    size_t count = 0;
+    for (size_t c = 0; c < job->chunk_count; c++) {
+        Channel* part = job->chunks[c].channels[index];
+        memcpy(channel->values + count, part->values, part->message_count * sizeof(double));
+        if (!follows_rows) {
+            memcpy(time_base->timestamps + count, part->time_base->timestamps,
+                   part->message_count * sizeof(double));
+        }
+        count += part->message_count;
+    }
+    channel->message_count = count;
+
+    channel_set_time_base(channel, time_base);
+    if (!follows_rows) {
+        time_base->count = count;
+        time_base_release(time_base);
+    }
+}
+
+// Splits [begin, end) into up to chunk_count ranges that each start at the beginning of a
+// row. Rows are found quote aware, a newline inside a quoted cell never starts a chunk
+static size_t split_csv_body(const char* begin, const char* end, CsvChunk* chunks, size_t chunk_count) {
+    size_t size = (size_t)(end - begin);
+    size_t* stops = malloc(chunk_count * sizeof(size_t));
+    if (!stops) {
+        // one chunk parses the same rows, just without the other threads
+        chunks[0].begin = begin;
+        chunks[0].end = end;
+        return 1;
+    }
+
+    for (size_t i = 0; i + 1 < chunk_count; i++) stops[i] = size / chunk_count * (i + 1);
+    csv_align_rows(begin, size, stops, chunk_count - 1);
+    stops[chunk_count - 1] = size;
+
+    const char* start = begin;
+    size_t used = 0;
+    for (size_t i = 0; i < chunk_count && start < end; i++) {
+        // a long row can swallow the next split point, its chunk would be empty
+        if (begin + stops[i] <= start) continue;
+        chunks[used].begin = start;
+        chunks[used].end = begin + stops[i];
+        start = chunks[used].end;
+        used++;
+    }
+    free(stops);
+    return used;
+}
+
+// Frees the thread-local channels of every chunk
+static void free_csv_chunks(CsvChunk* chunks, size_t chunk_count) {
+    for (size_t c = 0; c < chunk_count; c++) {
+        if (chunks[c].channels) {
+            for (size_t i = 0; i < chunks[c].channel_count; i++) {
+                channel_destroy(chunks[c].channels[i]);
             }
+            free(chunks[c].channels);
+        }
+        time_base_release(chunks[c].rows);
+    }
+    free(chunks);
+}
+
+// Creates the row time base of a chunk and attaches channels to it, 0 = good, -1 = bad
+static int attach_csv_rows(CsvChunk* chunk, Channel** channels, size_t channel_count) {
+    chunk->rows = time_base_create(1);
+    if (!chunk->rows) return -1;
+
+    chunk->channels = channels;
+    chunk->channel_count = channel_count;
+    for (size_t i = 0; i < channel_count; i++) {
+        channel_set_time_base(channels[i], chunk->rows);
+    }
+    return 0;
+}
+
+// Parses the CSV body on thread_count threads. Each thread fills its own channels
+// and the results are concatenated in file order, so the output is identical to one thread
+static int parse_csv_body(DataLog* log, const char* begin, const char* end, int thread_count,
+                          double* first_timestamp, double* last_timestamp) {
+    size_t chunk_count = (size_t)(thread_count > 1 ? thread_count : 1);
+    size_t max_chunks = (size_t)(end - begin) / MIN_CHUNK_BYTES + 1;
+    if (chunk_count > max_chunks) chunk_count = max_chunks;
+
+    CsvChunk* chunks = calloc(chunk_count, sizeof(CsvChunk));
+    if (!chunks) return -1;
+
+    // with one chunk rows go straight into the log's channels, there is nothing to merge
+    if (chunk_count == 1) {
+        chunks[0].begin = begin;
+        chunks[0].end = end;
+        int failed = attach_csv_rows(&chunks[0], log->channels, log->channel_count) != 0;
+        if (!failed) {
+            parse_csv_chunk(&chunks[0]);
+            failed = chunks[0].failed;
+        }
+
+        TimeBase* rows = chunks[0].rows;
+        if (rows && rows->count > 0) {
+            *first_timestamp = rows->timestamps[0];
+            *last_timestamp = rows->timestamps[rows->count - 1];
+        }
+        // the row count was an estimate, hand back what blank and skipped lines didn't use
+        if (!failed) {
+            failed = time_base_reserve(rows, rows->count) != 0;
+            for (size_t i = 0; i < log->channel_count && !failed; i++) {
+                failed = channel_trim(log->channels[i]) != 0;
+            }
+        }
+        time_base_release(rows);
+        free(chunks);
+        return failed ? -1 : 0;
+    }
+
+    chunk_count = split_csv_body(begin, end, chunks, chunk_count);
+    int failed = 0;
+    for (size_t c = 0; c < chunk_count && !failed; c++) {
+        Channel** channels = calloc(log->channel_count, sizeof(Channel*));
+        if (!channels) {
+            failed = 1;
+            break;
+        }
+        for (size_t i = 0; i < log->channel_count && !failed; i++) {
+            channels[i] = channel_create("", "", 0, 1);
+            if (!channels[i]) failed = 1;
+        }
+        chunks[c].channels = channels;
+        chunks[c].channel_count = log->channel_count;
+        if (!failed) failed = attach_csv_rows(&chunks[c], channels, log->channel_count) != 0;
+    }
+
+    if (!failed) {
+        parallel_for(chunk_count, thread_count, parse_csv_chunk_task, chunks);
+        for (size_t c = 0; c < chunk_count; c++) failed |= chunks[c].failed;
+    }
+
+    TimeBase* rows = NULL;
+    if (!failed) {
+        size_t row_count = 0;
+        for (size_t c = 0; c < chunk_count; c++) row_count += chunks[c].rows->count;
+
+        rows = time_base_create(row_count);
+        failed = !rows;
+        for (size_t c = 0; c < chunk_count && !failed; c++) {
+            memcpy(rows->timestamps + rows->count, chunks[c].rows->timestamps,
+                   chunks[c].rows->count * sizeof(double));
+            rows->count += chunks[c].rows->count;
         }
     }
 
+    if (!failed) {
+        CsvMergeJob job = { log, rows, chunks, chunk_count, 0 };
+        parallel_for(log->channel_count, thread_count, merge_csv_channel_task, &job);
+        failed = job.failed;
+
+        if (rows->count > 0) {
+            *first_timestamp = rows->timestamps[0];
+            *last_timestamp = rows->timestamps[rows->count - 1];
+        }
+    }
+
+    time_base_release(rows);
+    free_csv_chunks(chunks, chunk_count);
+    return failed ? -1 : 0;
+}
+
+// Channel frequencies from the number of rows between the first and last timestamp
+static void set_row_frequencies(DataLog* log, double first_timestamp, double last_timestamp) {
     // gets channel frequencies, this may not be right on it's own but is probably due to errors above
     double duration = last_timestamp - first_timestamp;
     if (duration > 0) {
@@ -137,17 +368,33 @@ int datalog_from_csv_log(DataLog* log, FILE* f) {
             }
         }
     }
+}
 
-    for (int i = 0; i < column_count; i++) {
-        free(headers[i]);
-        if (i < unit_count) free(unit_tokens[i]);
-    }
-    free(headers);
-    free(unit_tokens);
-    free(header);
-    free(units);
-    
-    return 0;
+// CSV parsing over an in-memory buffer, the buffer is never copied or modified. 0 = good, -1 = bad
+int datalog_from_csv_buffer(DataLog* log, const char* data, size_t len) {
+    return datalog_from_csv_buffer_threaded(log, data, len, 1);
+}
+
+// Same as datalog_from_csv_buffer, with the rows split across thread_count threads
+int datalog_from_csv_buffer_threaded(DataLog* log, const char* data, size_t len, int thread_count) {
+    if (!log) return -1;
+
+    LogSchema* schema = log_schema_parse(LOG_SCHEMA_CSV, data, len);
+    if (!schema) return -1;
+
+    int result = datalog_from_schema_buffer(log, schema, data, len, thread_count);
+    log_schema_free(schema);
+    return result;
+}
+
+// CSV parsing from a stream, used when the input can't be mapped (pipes). 0 = good, -1 = bad
+int datalog_from_csv_log(DataLog* log, FILE* f) {
+    MappedFile input;
+    if (mapped_file_read_stream(&input, f) != 0) return -1;
+
+    int result = datalog_from_csv_buffer(log, input.data, input.size);
+    mapped_file_close(&input);
+    return result;
 }
 
 
@@ -169,19 +416,26 @@ void data_log_print_channels(DataLog* log) {
 double channel_avg_frequency(Channel* channel) {
     if (channel->message_count < 2) return 0.0;
     
-    double duration = channel->messages[channel->message_count-1].timestamp - 
-                     channel->messages[0].timestamp;
+    double duration = channel_timestamp(channel, channel->message_count - 1) - 
+                     channel_timestamp(channel, 0);
     if (duration <= 0.0) return 0.0;
     
     return (channel->message_count - 1) / duration;
 }
 
 
+// Frees a channel. One from an arena only gives back its values, the struct and
+// strings stay until the arena is reset
 void channel_destroy(Channel* channel) {
-    if (channel) {
+    if (!channel) return;
+
+    time_base_release(channel->time_base);
+    if (channel->arena) {
+        arena_free(channel->arena, channel->values, channel->message_capacity * sizeof(double));
+    } else {
         free(channel->name);
         free(channel->units);
-        free(channel->messages);
+        free(channel->values);
         free(channel);
     }
 }
@@ -201,26 +455,420 @@ void datalog_free(DataLog* log) {
     }
 }
 
-// placeholder for can stuff
-int datalog_from_can_log(DataLog* log, FILE* f, const char* dbc_path) {
+// FNV-1a over the channel name
+static uint64_t hash_channel_name(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Adds channel to the name index, which must have a free slot. When several channels
+// share a name the first one added keeps the slot, like a front to back search
+static void index_channel(DataLog* log, Channel* channel) {
+    size_t mask = log->index_capacity - 1;
+    size_t slot = (size_t)hash_channel_name(channel->name) & mask;
+    while (log->channel_index[slot]) {
+        if (strcmp(log->channel_index[slot]->name, channel->name) == 0) return;
+        slot = (slot + 1) & mask;
+    }
+    log->channel_index[slot] = channel;
+}
+
+// Refills the name index from log->channels, after channels were removed
+static void rebuild_channel_index(DataLog* log) {
+    if (!log->channel_index) return;
+    memset(log->channel_index, 0, sizeof(Channel*) * log->index_capacity);
+    for (size_t i = 0; i < log->channel_count; i++) index_channel(log, log->channels[i]);
+}
+
+// Grows the name index so it stays at most half full with one more channel, 0 = good, -1 = bad
+static int reserve_channel_index(DataLog* log) {
+    if ((log->channel_count + 1) * 2 <= log->index_capacity) return 0;
+
+    size_t capacity = log->index_capacity ? log->index_capacity * 2 : INITIAL_CHANNEL_CAPACITY * 2;
+    while ((log->channel_count + 1) * 2 > capacity) capacity *= 2;
+    Channel** index = calloc(capacity, sizeof(Channel*));
+    if (!index) return -1;
+    free(log->channel_index);
+    log->channel_index = index;
+    log->index_capacity = capacity;
+    rebuild_channel_index(log);
+    return 0;
+}
+
+// Looks a channel up by name through the open addressing index, NULL if the log has none.
+// With duplicate names it is the first of them
+Channel* datalog_find_channel(const DataLog* log, const char* name) {
+    if (!log->channel_index) return NULL;
+
+    size_t mask = log->index_capacity - 1;
+    size_t slot = (size_t)hash_channel_name(name) & mask;
+    while (log->channel_index[slot]) {
+        if (strcmp(log->channel_index[slot]->name, name) == 0) return log->channel_index[slot];
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+// Splits an Accessport header cell "Name (unit)" into a name and unit. A cell without
+// a trailing "(unit)" is all name. 0 = good, -1 = bad
+static int split_accessport_header(CsvField field, char** name, char** unit) {
+    csv_field_trim(&field);
+    CsvField name_field = field;
+    CsvField unit_field = { field.ptr + field.len, 0 };
+
+    if (field.len > 0 && field.ptr[field.len - 1] == ')') {
+        for (size_t i = field.len - 1; i-- > 0; ) {
+            if (field.ptr[i] == '(') {
+                name_field.len = i;
+                unit_field.ptr = field.ptr + i + 1;
+                unit_field.len = field.len - i - 2;
+                break;
+            }
+        }
+    }
+
+    *name = csv_field_dup(&name_field);
+    *unit = csv_field_dup(&unit_field);
+    if (!*name || !*unit) {
+        free(*name);
+        free(*unit);
+        return -1;
+    }
+    return 0;
+}
+
+// The "AP Info:[...]" column holds the device and map, not samples
+static int is_accessport_info(const char* name) {
+    return strncmp(name, ACCESSPORT_INFO_PREFIX, sizeof(ACCESSPORT_INFO_PREFIX) - 1) == 0;
+}
+
+// Drops the channels that were only created to keep the info column's cells aligned
+static void remove_accessport_info_channels(DataLog* log) {
+    size_t kept = 0;
+    for (size_t i = 0; i < log->channel_count; i++) {
+        if (is_accessport_info(log->channels[i]->name)) {
+            channel_destroy(log->channels[i]);
+        } else {
+            log->channels[kept++] = log->channels[i];
+        }
+    }
+    log->channel_count = kept;
+    rebuild_channel_index(log);
+}
+
+// Takes ownership of name and unit, 0 = good, -1 = bad
+static int add_schema_column(LogSchema* schema, char* name, char* unit) {
+    if (!name || !unit) goto fail;
+    if (schema->column_count >= schema->column_capacity) {
+        size_t capacity = schema->column_capacity ? schema->column_capacity * 2 : 64;
+        char** names = realloc(schema->names, capacity * sizeof(char*));
+        if (!names) goto fail;
+        schema->names = names;
+        char** units = realloc(schema->units, capacity * sizeof(char*));
+        if (!units) goto fail;
+        schema->units = units;
+        schema->column_capacity = capacity;
+    }
+    schema->names[schema->column_count] = name;
+    schema->units[schema->column_count] = unit;
+    schema->column_count++;
+    return 0;
+
+fail:
+    free(name);
+    free(unit);
     return -1;
 }
 
+// A names row then a units row, a column becomes a channel when it has both
+static int read_csv_columns(LogSchema* schema, CsvScanner* scanner) {
+    size_t header_count = 0;
+    if (!csv_scanner_next_row(scanner, &header_count)) return 0;
+
+    // the header row's field index is copied because the scanner reuses it for the units row
+    CsvField* header = malloc(sizeof(CsvField) * (header_count ? header_count : 1));
+    if (!header) return -1;
+    memcpy(header, scanner->fields, sizeof(CsvField) * header_count);
+
+    int result = 0;
+    size_t unit_count = 0;
+    if (csv_scanner_next_row(scanner, &unit_count)) {
+        for (size_t column = 1; column < header_count && column < unit_count && result == 0; column++) {
+            result = add_schema_column(schema, csv_field_dup(&header[column]), csv_field_dup(&scanner->fields[column]));
+        }
+    }
+    free(header);
+    return result;
+}
+
+// One "Name (unit)" row, every column after the time column becomes a channel
+static int read_accessport_columns(LogSchema* schema, CsvScanner* scanner) {
+    size_t header_count = 0;
+    if (!csv_scanner_next_row(scanner, &header_count)) return 0;
+
+    for (size_t column = 1; column < header_count; column++) {
+        char* name;
+        char* unit;
+        if (split_accessport_header(scanner->fields[column], &name, &unit) != 0 ||
+            add_schema_column(schema, name, unit) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Reads the channel names and units from the header rows of a CSV or Accessport log.
+// Parsing the header is separate from parsing the body so logs whose header rows are
+// identical can share one schema. NULL = bad
+LogSchema* log_schema_parse(LogSchemaFormat format, const char* data, size_t len) {
+    if (!data && len > 0) return NULL;
+
+    LogSchema* schema = calloc(1, sizeof(LogSchema));
+    if (!schema) return NULL;
+    schema->format = format;
+
+    // Accessport exports can start with a UTF-8 byte order mark, it stays part of the header
+    size_t start = 0;
+    if (format == LOG_SCHEMA_ACCESSPORT && len >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        start = 3;
+    }
+
+    CsvScanner scanner;
+    if (csv_scanner_init(&scanner, data + start, len - start) != 0) {
+        free(schema);
+        return NULL;
+    }
+    int result = format == LOG_SCHEMA_ACCESSPORT ? read_accessport_columns(schema, &scanner)
+                                                 : read_csv_columns(schema, &scanner);
+    schema->header_len = start + csv_scanner_offset(&scanner);
+    csv_scanner_free(&scanner);
+
+    schema->header = malloc(schema->header_len ? schema->header_len : 1);
+    if (result != 0 || !schema->header) {
+        log_schema_free(schema);
+        return NULL;
+    }
+    memcpy(schema->header, data, schema->header_len);
+    return schema;
+}
+
+// 1 if the log starts with exactly the header rows the schema was parsed from
+int log_schema_matches(const LogSchema* schema, const char* data, size_t len) {
+    if (len < schema->header_len) return 0;
+    return schema->header_len == 0 || memcmp(schema->header, data, schema->header_len) == 0;
+}
 
-// placeholder for accessport stuff
+void log_schema_free(LogSchema* schema) {
+    if (!schema) return;
+    for (size_t i = 0; i < schema->column_count; i++) {
+        free(schema->names[i]);
+        free(schema->units[i]);
+    }
+    free(schema->names);
+    free(schema->units);
+    free(schema->header);
+    free(schema);
+}
+
+// Parses the body of a log whose header rows match schema, creating one channel per
+// schema column. 0 = good, -1 = bad
+int datalog_from_schema_buffer(DataLog* log, const LogSchema* schema, const char* data, size_t len,
+                               int thread_count) {
+    if (!log || !schema || !log_schema_matches(schema, data, len)) return -1;
+
+    int failed = 0;
+    for (size_t i = 0; i < schema->column_count && !failed; i++) {
+        // sized once the body's row count is known
+        failed = !datalog_create_channel(log, schema->names[i], schema->units[i], 3, 1);
+    }
+
+    double first_timestamp = 0;
+    double last_timestamp = 0;
+    size_t body = schema->header_len;
+    if (!failed && body < len) {
+        failed = parse_csv_body(log, data + body, data + len, thread_count, &first_timestamp, &last_timestamp) != 0;
+    }
+    if (schema->format == LOG_SCHEMA_ACCESSPORT) remove_accessport_info_channels(log);
+    if (failed) return -1;
+
+    set_row_frequencies(log, first_timestamp, last_timestamp);
+    return 0;
+}
+
+// COBB Accessport parsing over an in-memory buffer. The export is a CSV whose single
+// header row names every column "Name (unit)", the body goes through the same
+// tokenizer and row parser as plain CSV, split across thread_count threads. 0 = good, -1 = bad
+int datalog_from_accessport_buffer(DataLog* log, const char* data, size_t len, int thread_count) {
+    if (!log) return -1;
+
+    LogSchema* schema = log_schema_parse(LOG_SCHEMA_ACCESSPORT, data, len);
+    if (!schema) return -1;
+
+    int result = datalog_from_schema_buffer(log, schema, data, len, thread_count);
+    log_schema_free(schema);
+    return result;
+}
+
+// Accessport parsing from a stream, used when the input can't be mapped (pipes). 0 = good, -1 = bad
 int datalog_from_accessport_log(DataLog* log, FILE* f) {
-    return -1;
+    MappedFile input;
+    if (mapped_file_read_stream(&input, f) != 0) return -1;
+
+    int result = datalog_from_accessport_buffer(log, input.data, input.size, 1);
+    mapped_file_close(&input);
+    return result;
 }
 
+// Starts following a log that has no channels yet, nothing is parsed until bytes are fed
+void csv_follow_init(CsvFollow* follow, DataLog* log, LogSchemaFormat format) {
+    memset(follow, 0, sizeof(CsvFollow));
+    follow->log = log;
+    follow->format = format;
+}
 
-void datalog_add_channel(DataLog* log, const char* name, const char* units, int decimals) {
+// Appends data to the bytes waiting to be parsed, 0 = good, -1 = bad
+static int follow_buffer(CsvFollow* follow, const char* data, size_t len) {
+    size_t needed = follow->pending_len + len;
+    if (needed > follow->pending_capacity) {
+        size_t capacity = grow_capacity(follow->pending_capacity, needed);
+        char* pending = realloc(follow->pending, capacity);
+        if (!pending) return -1;
+        follow->pending = pending;
+        follow->pending_capacity = capacity;
+    }
+    memcpy(follow->pending + follow->pending_len, data, len);
+    follow->pending_len = needed;
+    return 0;
+}
+
+// Drops the first len pending bytes once they have been parsed
+static void follow_consume(CsvFollow* follow, size_t len) {
+    memmove(follow->pending, follow->pending + len, follow->pending_len - len);
+    follow->pending_len -= len;
+}
+
+// Creates a channel per column once the header rows are complete, every column shares the
+// row time base. 0 = good or still waiting for the header, -1 = bad
+static int follow_read_header(CsvFollow* follow) {
+    LogSchema* schema = log_schema_parse(follow->format, follow->pending, follow->pending_len);
+    if (!schema) return -1;
+    // a header cut off mid row still parses, it's only used once its rows have ended
+    if (schema->column_count == 0 ||
+        schema->header_len > csv_complete_len(follow->pending, follow->pending_len)) {
+        log_schema_free(schema);
+        return 0;
+    }
+
+    follow->schema = schema;
+    follow->columns = calloc(schema->column_count, sizeof(Channel*));
+    follow->rows = time_base_create(1);
+    if (!follow->columns || !follow->rows) return -1;
+
+    for (size_t i = 0; i < schema->column_count; i++) {
+        // the info column keeps its cells aligned without ever reaching the log
+        Channel* channel = follow->format == LOG_SCHEMA_ACCESSPORT && is_accessport_info(schema->names[i])
+            ? channel_create(schema->names[i], schema->units[i], 3, 1)
+            : datalog_create_channel(follow->log, schema->names[i], schema->units[i], 3, 1);
+        if (!channel) return -1;
+        follow->columns[i] = channel;
+        follow->column_count++;
+        channel_set_time_base(channel, follow->rows);
+    }
+    follow_consume(follow, schema->header_len);
+    return 0;
+}
+
+// Feeds the next bytes appended to the followed log and parses every row they complete,
+// the log's channel frequencies are updated to match. 0 = good, -1 = bad
+int csv_follow_feed(CsvFollow* follow, const char* data, size_t len) {
+    if (follow_buffer(follow, data, len) != 0) return -1;
+    if (!follow->schema && follow_read_header(follow) != 0) return -1;
+    if (!follow->schema) return 0;
+
+    size_t complete = csv_complete_len(follow->pending, follow->pending_len);
+    if (complete == 0) return 0;
+
+    CsvChunk chunk = { follow->pending, follow->pending + complete, follow->rows,
+                       follow->columns, follow->column_count, 0 };
+    parse_csv_chunk(&chunk);
+    follow_consume(follow, complete);
+    if (chunk.failed) return -1;
+
+    TimeBase* rows = follow->rows;
+    if (rows->count > 0) set_row_frequencies(follow->log, rows->timestamps[0], rows->timestamps[rows->count - 1]);
+    return 0;
+}
+
+// Releases the follower's buffers and info columns, the log keeps its channels
+void csv_follow_free(CsvFollow* follow) {
+    for (size_t i = 0; i < follow->column_count; i++) {
+        if (!follow->columns[i]->arena) channel_destroy(follow->columns[i]);
+    }
+    free(follow->columns);
+    time_base_release(follow->rows);
+    log_schema_free(follow->schema);
+    free(follow->pending);
+    memset(follow, 0, sizeof(CsvFollow));
+}
+
+// Copies every channel of log into a new log, the copies share their time bases with
+// the originals. The copy can be resampled while log keeps growing. NULL = bad
+DataLog* datalog_snapshot(const DataLog* log) {
+    DataLog* snapshot = datalog_create(log->name);
+    if (!snapshot) return NULL;
+
+    for (size_t i = 0; i < log->channel_count; i++) {
+        const Channel* source = log->channels[i];
+        Channel* channel = datalog_create_channel(snapshot, source->name, source->units, source->decimals,
+                                                  source->message_count);
+        if (!channel) {
+            datalog_destroy(snapshot);
+            return NULL;
+        }
+        memcpy(channel->values, source->values, source->message_count * sizeof(double));
+        channel->message_count = source->message_count;
+        channel->data_type = source->data_type;
+        channel->frequency = source->frequency;
+        channel_set_time_base(channel, source->time_base);
+    }
+    return snapshot;
+}
+
+
+// Adds a channel to the log, which takes ownership of it. 0 = good, -1 = bad
+int datalog_append_channel(DataLog* log, Channel* channel) {
     if (log->channel_count >= log->channel_capacity) {
-        log->channel_capacity *= 2;
-        log->channels = realloc(log->channels, sizeof(Channel*) * log->channel_capacity);
+        size_t capacity = log->channel_capacity ? log->channel_capacity * 2 : INITIAL_CHANNEL_CAPACITY;
+        Channel** channels = realloc(log->channels, sizeof(Channel*) * capacity);
+        if (!channels) return -1;
+        log->channels = channels;
+        log->channel_capacity = capacity;
     }
-    
-    Channel* channel = channel_create(name, units, decimals, 1000);
+    if (reserve_channel_index(log) != 0) return -1;
+
     log->channels[log->channel_count++] = channel;
+    index_channel(log, channel);
+    return 0;
+}
+
+// Creates a channel in the log's arena and adds it to the log, NULL = bad
+Channel* datalog_create_channel(DataLog* log, const char* name, const char* units, int decimals,
+                                size_t initial_size) {
+    Channel* channel = channel_create_in(&log->arena, name, units, decimals, initial_size);
+    if (!channel) return NULL;
+    if (datalog_append_channel(log, channel) != 0) {
+        channel_destroy(channel);
+        return NULL;
+    }
+    return channel;
+}
+
+void datalog_add_channel(DataLog* log, const char* name, const char* units, int decimals) {
+    datalog_create_channel(log, name, units, decimals, 1000);
 }
 
 double datalog_start(DataLog* log) {
@@ -228,48 +876,248 @@ double datalog_start(DataLog* log) {
     
     double earliest = DBL_MAX;
     for (size_t i = 0; i < log->channel_count; i++) {
+        if (log->channels[i]->message_count == 0) continue;
         double start = channel_start(log->channels[i]);
         if (start < earliest) earliest = start;
     }
-    return earliest;
+    return earliest == DBL_MAX ? 0.0 : earliest;
 }
 
 double datalog_end(DataLog* log) {
     if (log->channel_count == 0) return 0.0;
     
-    double latest = 0.0;
+    double latest = -DBL_MAX;
     for (size_t i = 0; i < log->channel_count; i++) {
+        if (log->channels[i]->message_count == 0) continue;
         double end = channel_end(log->channels[i]);
         if (end > latest) latest = end;
     }
-    return latest;
+    return latest == -DBL_MAX ? 0.0 : latest;
+}
+
+
+// Creates an empty time base, the caller holds its first reference
+TimeBase* time_base_create(size_t initial_size) {
+    TimeBase* time_base = (TimeBase*)malloc(sizeof(TimeBase));
+    if (!time_base) return NULL;
+
+    if (initial_size == 0) initial_size = 1;
+    time_base->timestamps = (double*)malloc(sizeof(double) * initial_size);
+    if (!time_base->timestamps) {
+        free(time_base);
+        return NULL;
+    }
+    time_base->count = 0;
+    time_base->capacity = initial_size;
+    time_base->refs = 1;
+    STATS_ADD(STAT_ALLOCATIONS, 1);
+
+    return time_base;
+}
+
+// Reference counts are atomic since channels of one log can be rebuilt on different threads
+void time_base_retain(TimeBase* time_base) {
+    if (time_base) __atomic_add_fetch(&time_base->refs, 1, __ATOMIC_RELAXED);
+}
+
+void time_base_release(TimeBase* time_base) {
+    if (time_base && __atomic_sub_fetch(&time_base->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(time_base->timestamps);
+        free(time_base);
+    }
 }
 
+// Resizes the timestamps to capacity (at least count), 0 = good, -1 = bad
+int time_base_reserve(TimeBase* time_base, size_t capacity) {
+    if (capacity < time_base->count) capacity = time_base->count;
+    if (capacity == 0) capacity = 1;
+    if (capacity == time_base->capacity) return 0;
+
+    double* timestamps = realloc(time_base->timestamps, sizeof(double) * capacity);
+    if (!timestamps) return -1;
+    STATS_ADD(STAT_ALLOCATIONS, 1);
+    time_base->timestamps = timestamps;
+    time_base->capacity = capacity;
+    return 0;
+}
+
+// Appends a timestamp, 0 = good, -1 = bad
+int time_base_append(TimeBase* time_base, double timestamp) {
+    if (time_base->count >= time_base->capacity &&
+        time_base_reserve(time_base, time_base->capacity * 2) != 0) {
+        return -1;
+    }
+
+    time_base->timestamps[time_base->count++] = timestamp;
+    return 0;
+}
 
 Channel* channel_create(const char* name, const char* units, int decimals, size_t initial_size) {
-    Channel* channel = (Channel*)malloc(sizeof(Channel));
+    return channel_create_in(NULL, name, units, decimals, initial_size);
+}
+
+// Creates a channel whose struct, strings and values come from arena, or from the heap
+// when arena is NULL
+Channel* channel_create_in(Arena* arena, const char* name, const char* units, int decimals,
+                           size_t initial_size) {
+    Channel* channel = arena ? arena_alloc(arena, sizeof(Channel)) : malloc(sizeof(Channel));
     if (!channel) return NULL;
     
-    channel->name = strdup(name);
-    channel->units = strdup(units);
+    if (initial_size == 0) initial_size = 1;
+    channel->arena = arena;
+    channel->name = arena ? arena_strdup(arena, name) : strdup(name);
+    channel->units = arena ? arena_strdup(arena, units) : strdup(units);
     channel->decimals = decimals;
     channel->message_count = 0;
     channel->message_capacity = initial_size;
-    channel->messages = (Message*)malloc(sizeof(Message) * initial_size);
+    channel->values = channel_alloc_values(channel, initial_size);
+    channel->time_base = time_base_create(initial_size);
     channel->data_type = NULL;
     channel->frequency = 0.0;
+
+    if (!channel->name || !channel->units || !channel->values || !channel->time_base) {
+        channel_destroy(channel);
+        return NULL;
+    }
+    STATS_ADD(STAT_ALLOCATIONS, 1);
     
     return channel;
 }
 
+// Room for count values from wherever the channel keeps its values, NULL = bad
+double* channel_alloc_values(Channel* channel, size_t count) {
+    size_t size = sizeof(double) * (count ? count : 1);
+    return channel->arena ? arena_alloc(channel->arena, size) : malloc(size);
+}
+
+// Resizes the channel's values to capacity (at least message_count), 0 = good, -1 = bad
+int channel_reserve(Channel* channel, size_t capacity) {
+    if (capacity < channel->message_count) capacity = channel->message_count;
+    if (capacity == 0) capacity = 1;
+    if (capacity == channel->message_capacity) return 0;
+
+    double* values;
+    if (channel->arena) {
+        values = arena_realloc(channel->arena, channel->values, sizeof(double) * channel->message_capacity,
+                               sizeof(double) * capacity);
+    } else {
+        values = realloc(channel->values, sizeof(double) * capacity);
+    }
+    if (!values) return -1;
+    STATS_ADD(STAT_ALLOCATIONS, 1);
+    channel->values = values;
+    channel->message_capacity = capacity;
+    return 0;
+}
+
+// Shrinks the channel's values, and its timestamps when no other channel shares them,
+// to what it holds. 0 = good, -1 = bad
+int channel_trim(Channel* channel) {
+    if (channel_reserve(channel, channel->message_count) != 0) return -1;
+    TimeBase* time_base = channel->time_base;
+    if (__atomic_load_n(&time_base->refs, __ATOMIC_ACQUIRE) > 1) return 0;
+    return time_base_reserve(time_base, time_base->count);
+}
+
+// Replaces the channel's values with count values from channel_alloc_values
+void channel_set_values(Channel* channel, double* values, size_t count) {
+    if (channel->arena) {
+        arena_free(channel->arena, channel->values, sizeof(double) * channel->message_capacity);
+    } else {
+        free(channel->values);
+    }
+    channel->values = values;
+    channel->message_count = count;
+    channel->message_capacity = count ? count : 1;
+}
+
+// Makes channel reference time_base, its first message_count timestamps must be the channel's
+void channel_set_time_base(Channel* channel, TimeBase* time_base) {
+    time_base_retain(time_base);
+    time_base_release(channel->time_base);
+    channel->time_base = time_base;
+}
+
+// Appends a message, 0 = good, -1 = bad. While the channel's timestamps match a shared
+// time base only the value is stored, the first time they don't it gets its own copy
+int channel_append(Channel* channel, double timestamp, double value) {
+    TimeBase* time_base = channel->time_base;
+    size_t count = channel->message_count;
+
+    if (channel->message_count >= channel->message_capacity &&
+        channel_reserve(channel, channel->message_capacity * 2) != 0) {
+        return -1;
+    }
+
+    if (__atomic_load_n(&time_base->refs, __ATOMIC_ACQUIRE) > 1) {
+        if (count < time_base->count && time_base->timestamps[count] == timestamp) {
+            channel->values[channel->message_count++] = value;
+            return 0;
+        }
+
+        TimeBase* own = time_base_create(channel->message_capacity);
+        if (!own) return -1;
+        memcpy(own->timestamps, time_base->timestamps, sizeof(double) * count);
+        own->count = count;
+        time_base_release(time_base);
+        channel->time_base = time_base = own;
+    }
+
+    // the channel owns its time base, anything past its last value is stale
+    time_base->count = count;
+    if (time_base_append(time_base, timestamp) != 0) return -1;
+
+    channel->values[channel->message_count++] = value;
+    return 0;
+}
+
+// Appends count messages, the same as calling channel_append for each of them but with
+// the values (and timestamps, unless they match a shared time base) copied in bulk. 0 = good, -1 = bad
+int channel_append_many(Channel* channel, const double* timestamps, const double* values, size_t count) {
+    size_t total = channel->message_count + count;
+    if (total > channel->message_capacity) {
+        size_t new_capacity = channel->message_capacity * 2;
+        if (new_capacity < total) new_capacity = total;
+        if (channel_reserve(channel, new_capacity) != 0) return -1;
+    }
+
+    TimeBase* time_base = channel->time_base;
+    size_t start = channel->message_count;
+    if (__atomic_load_n(&time_base->refs, __ATOMIC_ACQUIRE) > 1) {
+        if (total <= time_base->count &&
+            memcmp(time_base->timestamps + start, timestamps, sizeof(double) * count) == 0) {
+            memcpy(channel->values + start, values, sizeof(double) * count);
+            channel->message_count = total;
+            return 0;
+        }
+        // diverges from the shared time base somewhere in this run
+        for (size_t i = 0; i < count; i++) {
+            if (channel_append(channel, timestamps[i], values[i]) != 0) return -1;
+        }
+        return 0;
+    }
+
+    time_base->count = start;
+    if (total > time_base->capacity) {
+        size_t new_capacity = time_base->capacity * 2;
+        if (new_capacity < total) new_capacity = total;
+        if (time_base_reserve(time_base, new_capacity) != 0) return -1;
+    }
+    memcpy(time_base->timestamps + start, timestamps, sizeof(double) * count);
+    memcpy(channel->values + start, values, sizeof(double) * count);
+    time_base->count = total;
+    channel->message_count = total;
+    return 0;
+}
+
 double channel_start(Channel* channel) {
     if (!channel || channel->message_count == 0) return 0.0;
-    return channel->messages[0].timestamp;
+    return channel_timestamp(channel, 0);
 }
 
 double channel_end(Channel* channel) {
     if (!channel || channel->message_count == 0) return 0.0;
-    return channel->messages[channel->message_count - 1].timestamp;
+    return channel_timestamp(channel, channel->message_count - 1);
 }
 
 
@@ -281,19 +1129,3 @@ void trim_whitespace(char* str) {
     while(end > str && isspace((unsigned char)*end)) end--;
     end[1] = '\0';
 }
-
-
-char** split_csv_line(char* line, int* count) {
-    char** tokens = malloc(MAX_COLUMNS * sizeof(char*));
-    *count = 0;
-    char* token = strtok(line, ",");
-    
-    while (token != NULL && *count < MAX_COLUMNS) {
-        tokens[*count] = strdup(token);
-        trim_whitespace(tokens[*count]);
-        (*count)++;
-        token = strtok(NULL, ",");
-    }
-    
-    return tokens;
-}
\ No newline at end of file
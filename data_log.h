@@ -6,39 +6,102 @@
 #include <string.h>
 #include <float.h>
 #include <math.h>
+#include <stdint.h>
+#include "arena.h"
 
-// Message structure
-typedef struct Message {
-    double timestamp; // time when data was recorded
-    double value; // the actual value recorded at that time stamp
-} Message;
+// Timestamps of one time base. Channels sampled on the same rows (every CSV
+// column, every resampled channel) reference one TimeBase instead of each
+// keeping a copy, a channel's value i was recorded at timestamps[i]
+typedef struct TimeBase {
+    double* timestamps;
+    size_t count;
+    size_t capacity;
+    int refs; // number of channels (and builders) holding this time base
+} TimeBase;
 
-// Channel structure
+// Channel structure, values are stored column-wise next to a possibly shared time base
 typedef struct Channel {
+    Arena* arena; // owns the struct, strings and values when set, otherwise they are on the heap
     char* name;
     char* units;
     int decimals; // number of decimals for display
-    Message* messages;
+    TimeBase* time_base; // timestamps, the first message_count of them belong to this channel
+    double* values; // the actual values recorded at those timestamps
     size_t message_count; // current number of messages
     size_t message_capacity;
     double (*data_type)(double); // Function pointer for datatype conversion
     double frequency;
 } Channel;
 
+// How datalog_resample_with fills the uniform grid
+typedef enum {
+    RESAMPLE_LINEAR, // linear interpolation between the neighbouring samples
+    RESAMPLE_HOLD    // zero-order hold, the last sample at or before each grid point
+} ResampleMethod;
+
 // DataLog structure
 typedef struct DataLog {
     char* name; 
     Channel** channels; // pointer to channel structures
     size_t channel_count; // number of channels currently in use
     size_t channel_capacity; 
+    Channel** channel_index; // open addressing hash on channel name, NULL slots are free
+    size_t index_capacity; // power of two, kept at most half full
+    Arena arena; // channels created with datalog_create_channel, released together
 } DataLog;
 
+// Header rows a CSV log can start with
+typedef enum {
+    LOG_SCHEMA_CSV,       // a names row then a units row
+    LOG_SCHEMA_ACCESSPORT // one "Name (unit)" row
+} LogSchemaFormat;
+
+// Channel names and units parsed from a log's header rows, column i after the time
+// column becomes channel i. Logs that start with the same header bytes share a schema
+typedef struct LogSchema {
+    LogSchemaFormat format;
+    char* header; // the header rows as they appear in the log, body parsing starts after them
+    size_t header_len;
+    char** names;
+    char** units;
+    size_t column_count;
+    size_t column_capacity;
+} LogSchema;
+
+// Parses a CSV or Accessport log that is still being written. Bytes are fed in as they
+// are appended to the file and every complete row is added to the log's channels, a
+// trailing partial row waits for the rest of its bytes
+typedef struct CsvFollow {
+    DataLog* log;
+    LogSchemaFormat format;
+    LogSchema* schema; // NULL until the header rows are complete
+    Channel** columns; // channel of every schema column, Accessport info columns aren't in the log
+    size_t column_count;
+    TimeBase* rows; // timestamp of every row parsed so far, shared by the columns
+    char* pending; // bytes fed in but not parsed yet, never more than one partial row after a feed
+    size_t pending_len;
+    size_t pending_capacity;
+} CsvFollow;
+
+struct DbcPlan;
 
 void trim_whitespace(char* str);
 
 int datalog_from_can_log(DataLog* log, FILE* f, const char* dbc_path);
+int datalog_from_can_buffer(DataLog* log, const char* data, size_t len, const struct DbcPlan* plan);
 int datalog_from_csv_log(DataLog* log, FILE* f);
+int datalog_from_csv_buffer(DataLog* log, const char* data, size_t len);
+int datalog_from_csv_buffer_threaded(DataLog* log, const char* data, size_t len, int thread_count);
 int datalog_from_accessport_log(DataLog* log, FILE* f);
+int datalog_from_accessport_buffer(DataLog* log, const char* data, size_t len, int thread_count);
+LogSchema* log_schema_parse(LogSchemaFormat format, const char* data, size_t len);
+int log_schema_matches(const LogSchema* schema, const char* data, size_t len);
+void log_schema_free(LogSchema* schema);
+int datalog_from_schema_buffer(DataLog* log, const LogSchema* schema, const char* data, size_t len,
+                               int thread_count);
+void csv_follow_init(CsvFollow* follow, DataLog* log, LogSchemaFormat format);
+int csv_follow_feed(CsvFollow* follow, const char* data, size_t len);
+void csv_follow_free(CsvFollow* follow);
 int datalog_channel_count(DataLog* log);
 void datalog_free(DataLog* log);
 void data_log_print_channels(DataLog* log);
@@ -46,19 +109,70 @@ DataLog* datalog_create(const char* name);
 void datalog_destroy(DataLog* log);
 void datalog_clear(DataLog* log);
 void datalog_add_channel(DataLog* log, const char* name, const char* units, int decimals);
+int datalog_append_channel(DataLog* log, Channel* channel);
+Channel* datalog_find_channel(const DataLog* log, const char* name);
+DataLog* datalog_snapshot(const DataLog* log);
+Channel* datalog_create_channel(DataLog* log, const char* name, const char* units, int decimals,
+                                size_t initial_size);
 double datalog_start(DataLog* log);
 double datalog_end(DataLog* log);
 double datalog_duration(DataLog* log);
 void datalog_resample(DataLog* log, double frequency);
+int datalog_resample_with(DataLog* log, double frequency, ResampleMethod method, int thread_count);
+size_t resample_grid_count(double start, double end, double frequency);
 int datalog_from_csv(DataLog* log, const char* filename);
 
 
 
+TimeBase* time_base_create(size_t initial_size);
+void time_base_retain(TimeBase* time_base);
+void time_base_release(TimeBase* time_base);
+int time_base_reserve(TimeBase* time_base, size_t capacity);
+int time_base_append(TimeBase* time_base, double timestamp);
+
 Channel* channel_create(const char* name, const char* units, int decimals, size_t initial_size);
+Channel* channel_create_in(Arena* arena, const char* name, const char* units, int decimals,
+                           size_t initial_size);
+double* channel_alloc_values(Channel* channel, size_t count);
+int channel_reserve(Channel* channel, size_t capacity);
+int channel_trim(Channel* channel);
+void channel_set_values(Channel* channel, double* values, size_t count);
 void channel_destroy(Channel* channel);
+void channel_set_time_base(Channel* channel, TimeBase* time_base);
+int channel_append(Channel* channel, double timestamp, double value);
+int channel_append_many(Channel* channel, const double* timestamps, const double* values, size_t count);
 double channel_start(Channel* channel);
 double channel_end(Channel* channel);
 double channel_avg_frequency(Channel* channel);
 
+static inline double channel_timestamp(const Channel* channel, size_t index) {
+    return channel->time_base->timestamps[index];
+}
+
+static inline double channel_value(const Channel* channel, size_t index) {
+    return channel->values[index];
+}
+
+// Value at grid time t from the source samples (t0, v0) and (t1, v1) that bracket it
+static inline double resample_interpolate(double t0, double v0, double t1, double v1, double t,
+                                          ResampleMethod method) {
+    if (method == RESAMPLE_HOLD) return t >= t1 ? v1 : v0;
+
+    double dt = t1 - t0;
+    double w;
+    if (dt > 0.0) {
+        w = (t - t0) / dt;
+        w = w < 0.0 ? 0.0 : (w > 1.0 ? 1.0 : w);
+    } else {
+        w = t >= t1 ? 1.0 : 0.0;
+    }
+    return v0 + (v1 - v0) * w;
+}
+
+// Time of grid point k when resampling from start at frequency Hz
+static inline double resample_grid_time(double start, double frequency, size_t k) {
+    return start + (double)k / frequency;
+}
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "dbc.h"
+#include "mapped_file.h"
+#include "number_parse.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define INITIAL_MESSAGE_CAPACITY 64
+#define INITIAL_SIGNAL_CAPACITY 8
+#define MAX_DECIMALS 6
+
+// Cursor over one line of the DBC file, every reader stops at end
+typedef struct DbcCursor {
+    const char* p;
+    const char* end;
+} DbcCursor;
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int is_identifier(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void skip_spaces(DbcCursor* c) {
+    while (c->p < c->end && is_space(*c->p)) c->p++;
+}
+
+// Consumes ch after optional spaces, 1 if it was there
+static int expect_char(DbcCursor* c, char ch) {
+    skip_spaces(c);
+    if (c->p >= c->end || *c->p != ch) return 0;
+    c->p++;
+    return 1;
+}
+
+// Consumes word if it is the next token, 1 if it was there
+static int expect_word(DbcCursor* c, const char* word) {
+    skip_spaces(c);
+    size_t len = strlen(word);
+    if ((size_t)(c->end - c->p) < len || memcmp(c->p, word, len) != 0) return 0;
+    if (c->p + len < c->end && is_identifier(c->p[len])) return 0;
+    c->p += len;
+    return 1;
+}
+
+// Returns a copy of the identifier at the cursor, NULL if there is none
+static char* read_identifier(DbcCursor* c) {
+    skip_spaces(c);
+    const char* start = c->p;
+    while (c->p < c->end && is_identifier(*c->p)) c->p++;
+    if (c->p == start) return NULL;
+    return strndup(start, (size_t)(c->p - start));
+}
+
+static int read_uint(DbcCursor* c, uint32_t* value) {
+    skip_spaces(c);
+    const char* start = c->p;
+    uint64_t v = 0;
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9' && v <= UINT32_MAX) {
+        v = v * 10 + (uint64_t)(*c->p++ - '0');
+    }
+    if (c->p == start || v > UINT32_MAX) return 0;
+    *value = (uint32_t)v;
+    return 1;
+}
+
+static int read_double(DbcCursor* c, double* value) {
+    skip_spaces(c);
+    size_t used = parse_number(c->p, c->end, value);
+    c->p += used;
+    return used > 0;
+}
+
+// Returns a copy of the quoted string at the cursor, NULL if there is none
+static char* read_quoted(DbcCursor* c) {
+    if (!expect_char(c, '"')) return NULL;
+    const char* start = c->p;
+    while (c->p < c->end && *c->p != '"') c->p++;
+    if (c->p >= c->end) return NULL;
+    return strndup(start, (size_t)(c->p++ - start));
+}
+
+// Payload bytes up to and including the signal's last bit
+static uint16_t signal_end_byte(const DbcSignal* signal) {
+    if (signal->little_endian) {
+        return (uint16_t)((signal->start_bit + signal->length - 1) / 8 + 1);
+    }
+    // big endian signals run from the MSB towards higher bytes, sawtooth bit numbering
+    unsigned bit = signal->start_bit;
+    for (unsigned i = 1; i < signal->length; i++) {
+        bit = bit % 8 == 0 ? bit + 15 : bit - 1;
+    }
+    return (uint16_t)(bit / 8 + 1);
+}
+
+static int add_message(DbcDatabase* dbc, uint32_t id, char* name, uint16_t dlc) {
+    if (dbc->message_count >= dbc->message_capacity) {
+        size_t capacity = dbc->message_capacity ? dbc->message_capacity * 2 : INITIAL_MESSAGE_CAPACITY;
+        DbcMessage* messages = realloc(dbc->messages, capacity * sizeof(DbcMessage));
+        if (!messages) return -1;
+        dbc->messages = messages;
+        dbc->message_capacity = capacity;
+    }
+
+    DbcMessage* message = &dbc->messages[dbc->message_count++];
+    memset(message, 0, sizeof(DbcMessage));
+    // bit 31 marks extended IDs in the DBC just like in CAN_EXTENDED_FLAG
+    message->id = id;
+    message->name = name;
+    message->dlc = dlc;
+    return 0;
+}
+
+static int add_signal(DbcMessage* message, const DbcSignal* signal) {
+    if (message->signal_count >= message->signal_capacity) {
+        size_t capacity = message->signal_capacity ? message->signal_capacity * 2 : INITIAL_SIGNAL_CAPACITY;
+        DbcSignal* signals = realloc(message->signals, capacity * sizeof(DbcSignal));
+        if (!signals) return -1;
+        message->signals = signals;
+        message->signal_capacity = capacity;
+    }
+    message->signals[message->signal_count++] = *signal;
+    return 0;
+}
+
+// BO_ <id> <name>: <dlc> <transmitter>
+static int parse_message(DbcDatabase* dbc, DbcCursor* c) {
+    uint32_t id, dlc;
+    if (!read_uint(c, &id)) return 0;
+    char* name = read_identifier(c);
+    if (!name) return 0;
+    if (!expect_char(c, ':') || !read_uint(c, &dlc) || dlc > CAN_MAX_DATA) {
+        free(name);
+        return 0;
+    }
+    if (add_message(dbc, id, name, (uint16_t)dlc) != 0) {
+        free(name);
+        return -1;
+    }
+    return 0;
+}
+
+// SG_ <name> [M|m<n>] : <start>|<length>@<order><sign> (<factor>,<offset>) [<min>|<max>] "<unit>" <receivers>
+static int parse_signal(DbcMessage* message, DbcCursor* c) {
+    DbcSignal signal;
+    memset(&signal, 0, sizeof(signal));
+
+    signal.name = read_identifier(c);
+    if (!signal.name) return 0;
+
+    skip_spaces(c);
+    if (c->p < c->end && *c->p == 'M') {
+        signal.mux_type = DBC_SIGNAL_MULTIPLEXOR;
+        c->p++;
+    } else if (c->p < c->end && *c->p == 'm') {
+        // extended multiplexing (m<n>M) is read as a plain multiplexed signal
+        c->p++;
+        if (!read_uint(c, &signal.mux_value)) goto skip;
+        signal.mux_type = DBC_SIGNAL_MULTIPLEXED;
+        if (c->p < c->end && *c->p == 'M') c->p++;
+    }
+
+    uint32_t start, length, order;
+    double minimum, maximum;
+    if (!expect_char(c, ':') || !read_uint(c, &start) || !expect_char(c, '|') ||
+        !read_uint(c, &length) || !expect_char(c, '@') || !read_uint(c, &order) ||
+        c->p >= c->end || (*c->p != '+' && *c->p != '-')) {
+        goto skip;
+    }
+    signal.is_signed = *c->p++ == '-';
+    if (!expect_char(c, '(') || !read_double(c, &signal.factor) || !expect_char(c, ',') ||
+        !read_double(c, &signal.offset) || !expect_char(c, ')') ||
+        !expect_char(c, '[') || !read_double(c, &minimum) || !expect_char(c, '|') ||
+        !read_double(c, &maximum) || !expect_char(c, ']')) {
+        goto skip;
+    }
+    signal.unit = read_quoted(c);
+    if (!signal.unit) goto skip;
+
+    if (length == 0 || length > 64 || start >= CAN_MAX_DATA * 8) goto skip;
+    signal.start_bit = (uint16_t)start;
+    signal.length = (uint16_t)length;
+    signal.little_endian = order == 1;
+    signal.end_byte = signal_end_byte(&signal);
+    if (signal.end_byte > CAN_MAX_DATA) goto skip;
+
+    if (add_signal(message, &signal) != 0) {
+        free(signal.name);
+        free(signal.unit);
+        return -1;
+    }
+    return 0;
+
+skip:
+    free(signal.name);
+    free(signal.unit);
+    return 0;
+}
+
+// Reads the BO_ and SG_ definitions of a DBC file held in memory, every other
+// section is ignored. Malformed lines are skipped. NULL = out of memory
+DbcDatabase* dbc_parse(const char* data, size_t len) {
+    DbcDatabase* dbc = calloc(1, sizeof(DbcDatabase));
+    if (!dbc) return NULL;
+
+    const char* p = data;
+    const char* end = data + len;
+    DbcMessage* message = NULL;
+    while (p < end) {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+
+        DbcCursor c = { p, eol };
+        int result = 0;
+        if (expect_word(&c, "BO_")) {
+            size_t before = dbc->message_count;
+            result = parse_message(dbc, &c);
+            message = dbc->message_count > before ? &dbc->messages[dbc->message_count - 1] : NULL;
+        } else if (expect_word(&c, "SG_")) {
+            if (message) result = parse_signal(message, &c);
+        } else if (c.p < c.end && !is_space(*c.p)) {
+            // any other top level keyword ends the current message's signal list
+            message = NULL;
+        }
+
+        if (result != 0) {
+            dbc_free(dbc);
+            return NULL;
+        }
+        p = eol + 1;
+    }
+    return dbc;
+}
+
+// Loads a DBC file, NULL = bad
+DbcDatabase* dbc_load(const char* path) {
+    MappedFile file;
+    if (mapped_file_open(&file, path, 1, MAPPED_ACCESS_NORMAL) != 0) return NULL;
+
+    DbcDatabase* dbc = dbc_parse(file.data, file.size);
+    mapped_file_close(&file);
+    return dbc;
+}
+
+void dbc_free(DbcDatabase* dbc) {
+    if (!dbc) return;
+    for (size_t i = 0; i < dbc->message_count; i++) {
+        DbcMessage* message = &dbc->messages[i];
+        for (size_t s = 0; s < message->signal_count; s++) {
+            free(message->signals[s].name);
+            free(message->signals[s].unit);
+        }
+        free(message->signals);
+        free(message->name);
+    }
+    free(dbc->messages);
+    free(dbc);
+}
+
+// The signal that selects a message's multiplexed signals, NULL if it has none
+const DbcSignal* dbc_multiplexor(const DbcMessage* message) {
+    for (size_t i = 0; i < message->signal_count; i++) {
+        if (message->signals[i].mux_type == DBC_SIGNAL_MULTIPLEXOR) return &message->signals[i];
+    }
+    return NULL;
+}
+
+static int value_decimals(double value) {
+    for (int d = 0; d < MAX_DECIMALS; d++) {
+        double scaled = value * pow(10.0, d);
+        if (fabs(scaled - round(scaled)) < 1e-9 * fmax(1.0, fabs(scaled))) return d;
+    }
+    return MAX_DECIMALS;
+}
+
+// Decimals needed to show every value the signal can take, from its factor and offset
+int dbc_signal_decimals(const DbcSignal* signal) {
+    int factor = value_decimals(signal->factor);
+    int offset = value_decimals(signal->offset);
+    return factor > offset ? factor : offset;
+}
@@ -0,0 +1,60 @@
+#ifndef DBC_H
+#define DBC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CAN IDs with this bit set are 29-bit extended IDs, the same convention DBC files use
+#define CAN_EXTENDED_FLAG 0x80000000u
+
+// Largest payload of a CAN FD frame. Payload buffers handed to the decoders are
+// CAN_PAYLOAD_SIZE bytes and zero past the frame's length, so a signal can always
+// be read with one 8-byte load
+#define CAN_MAX_DATA 64
+#define CAN_PAYLOAD_SIZE (CAN_MAX_DATA + 8)
+
+typedef enum {
+    DBC_SIGNAL_PLAIN,       // present in every frame of its message
+    DBC_SIGNAL_MULTIPLEXOR, // selects which multiplexed signals a frame carries
+    DBC_SIGNAL_MULTIPLEXED  // present only when the multiplexor equals mux_value
+} DbcMuxType;
+
+// One SG_ line: how to pull a signal out of its message's payload
+typedef struct DbcSignal {
+    char* name;
+    char* unit;
+    uint16_t start_bit; // LSB for little endian signals, MSB for big endian ones (DBC numbering)
+    uint16_t length;
+    int little_endian; // @1 in the DBC, @0 is big endian (Motorola)
+    int is_signed;
+    uint16_t end_byte; // payload bytes a frame needs to carry the whole signal
+    double factor;
+    double offset;
+    DbcMuxType mux_type;
+    uint32_t mux_value;
+} DbcSignal;
+
+// One BO_ block
+typedef struct DbcMessage {
+    uint32_t id; // CAN_EXTENDED_FLAG set for extended IDs
+    char* name;
+    uint16_t dlc;
+    DbcSignal* signals;
+    size_t signal_count;
+    size_t signal_capacity;
+} DbcMessage;
+
+typedef struct DbcDatabase {
+    DbcMessage* messages;
+    size_t message_count;
+    size_t message_capacity;
+} DbcDatabase;
+
+DbcDatabase* dbc_load(const char* path);
+DbcDatabase* dbc_parse(const char* data, size_t len);
+void dbc_free(DbcDatabase* dbc);
+
+const DbcSignal* dbc_multiplexor(const DbcMessage* message);
+int dbc_signal_decimals(const DbcSignal* signal);
+
+#endif
@@ -0,0 +1,368 @@
+#include "dbc_plan.h"
+#include "mapped_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PLAN_MAGIC "DBCPLAN"
+#define PLAN_VERSION 1
+#define CACHE_DIR_NAME "motec_log_generator"
+
+// Header of a cached plan, followed by the message, signal and string arrays
+typedef struct PlanFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint16_t message_size; // sizeof the structs, so a cache from another build is rejected
+    uint16_t signal_size;
+    uint64_t dbc_hash;
+    uint64_t message_count;
+    uint64_t signal_count;
+    uint64_t strings_size;
+} PlanFileHeader;
+
+// FNV-1a, plenty for telling DBC files apart
+uint64_t dbc_plan_hash(const char* data, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint32_t add_string(DbcPlan* plan, const char* s) {
+    size_t len = strlen(s) + 1;
+    uint32_t offset = (uint32_t)plan->strings_size;
+    memcpy(plan->strings + offset, s, len);
+    plan->strings_size += len;
+    return offset;
+}
+
+static void compile_signal(DbcPlan* plan, const DbcSignal* signal, DbcSignalPlan* out) {
+    memset(out, 0, sizeof(DbcSignalPlan));
+    unsigned bit = signal->start_bit % 8;
+    unsigned length = signal->length;
+
+    out->mask = length >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << length) - 1;
+    out->sign = signal->is_signed ? (uint64_t)1 << (length - 1) : 0;
+    out->factor = signal->factor;
+    out->offset = signal->offset;
+    out->name = add_string(plan, signal->name);
+    out->unit = add_string(plan, signal->unit);
+    out->mux_type = (uint8_t)signal->mux_type;
+    out->mux_value = signal->mux_value;
+    out->byte = signal->start_bit / 8;
+    out->start_bit = signal->start_bit;
+    out->length = (uint8_t)length;
+    out->end_byte = (uint8_t)signal->end_byte;
+    out->decimals = (uint8_t)dbc_signal_decimals(signal);
+    if (signal->is_signed) out->flags |= PLAN_SIGNED;
+
+    if (signal->little_endian) {
+        // the LSB is bit `bit` of the window
+        if (bit + length <= 64) {
+            out->shift = (uint8_t)bit;
+        } else {
+            out->flags |= PLAN_BITWISE;
+        }
+    } else {
+        // byte swapped, the MSB sits at bit 56 + bit of the window
+        out->flags |= PLAN_BIG_ENDIAN;
+        if (length <= bit + 57) {
+            out->shift = (uint8_t)(57 + bit - length);
+        } else {
+            out->flags |= PLAN_BITWISE;
+        }
+    }
+    // a full 64-bit unsigned raw value doesn't survive the signed conversion of the fast path
+    if (length == 64 && !signal->is_signed) out->flags |= PLAN_BITWISE;
+}
+
+// Compiles every message of dbc into a plan, NULL = out of memory
+DbcPlan* dbc_plan_compile(const DbcDatabase* dbc, uint64_t dbc_hash) {
+    DbcPlan* plan = calloc(1, sizeof(DbcPlan));
+    if (!plan) return NULL;
+    plan->dbc_hash = dbc_hash;
+
+    size_t signal_count = 0;
+    size_t strings_size = 0;
+    for (size_t i = 0; i < dbc->message_count; i++) {
+        const DbcMessage* message = &dbc->messages[i];
+        signal_count += message->signal_count;
+        for (size_t s = 0; s < message->signal_count; s++) {
+            strings_size += strlen(message->signals[s].name) + strlen(message->signals[s].unit) + 2;
+        }
+    }
+
+    plan->messages = calloc(dbc->message_count ? dbc->message_count : 1, sizeof(DbcMessagePlan));
+    plan->signals = calloc(signal_count ? signal_count : 1, sizeof(DbcSignalPlan));
+    plan->strings = malloc(strings_size ? strings_size : 1);
+    if (!plan->messages || !plan->signals || !plan->strings || strings_size > UINT32_MAX) {
+        dbc_plan_free(plan);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < dbc->message_count; i++) {
+        const DbcMessage* message = &dbc->messages[i];
+        DbcMessagePlan* out = &plan->messages[plan->message_count++];
+        out->id = message->id;
+        out->first_signal = (uint32_t)plan->signal_count;
+        out->signal_count = (uint32_t)message->signal_count;
+        out->multiplexor = -1;
+
+        for (size_t s = 0; s < message->signal_count; s++) {
+            const DbcSignal* signal = &message->signals[s];
+            if (signal->mux_type == DBC_SIGNAL_MULTIPLEXOR && out->multiplexor < 0) {
+                out->multiplexor = (int32_t)plan->signal_count;
+            }
+            compile_signal(plan, signal, &plan->signals[plan->signal_count++]);
+        }
+    }
+    return plan;
+}
+
+void dbc_plan_free(DbcPlan* plan) {
+    if (!plan) return;
+    free(plan->messages);
+    free(plan->signals);
+    free(plan->strings);
+    free(plan);
+}
+
+// Writes plan to path through a temporary file, so a reader never sees half a cache. 0 = good, -1 = bad
+int dbc_plan_save(const DbcPlan* plan, const char* path) {
+    PlanFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PLAN_MAGIC, sizeof(header.magic));
+    header.version = PLAN_VERSION;
+    header.message_size = sizeof(DbcMessagePlan);
+    header.signal_size = sizeof(DbcSignalPlan);
+    header.dbc_hash = plan->dbc_hash;
+    header.message_count = plan->message_count;
+    header.signal_count = plan->signal_count;
+    header.strings_size = plan->strings_size;
+
+    size_t len = strlen(path) + 32;
+    char* temp_path = malloc(len);
+    if (!temp_path) return -1;
+    snprintf(temp_path, len, "%s.%ld.tmp", path, (long)getpid());
+
+    FILE* f = fopen(temp_path, "wb");
+    if (!f) {
+        free(temp_path);
+        return -1;
+    }
+    int result = 0;
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+        fwrite(plan->messages, sizeof(DbcMessagePlan), plan->message_count, f) != plan->message_count ||
+        fwrite(plan->signals, sizeof(DbcSignalPlan), plan->signal_count, f) != plan->signal_count ||
+        fwrite(plan->strings, 1, plan->strings_size, f) != plan->strings_size) {
+        result = -1;
+    }
+    if (fclose(f) != 0) result = -1;
+
+    if (result == 0 && rename(temp_path, path) != 0) result = -1;
+    if (result != 0) unlink(temp_path);
+    free(temp_path);
+    return result;
+}
+
+// Checks that every index and offset of a plan read from disk stays inside its arrays
+static int plan_is_valid(const DbcPlan* plan) {
+    if (plan->strings_size == 0 ? plan->signal_count > 0 : plan->strings[plan->strings_size - 1] != '\0') {
+        return 0;
+    }
+    for (size_t i = 0; i < plan->message_count; i++) {
+        const DbcMessagePlan* message = &plan->messages[i];
+        if ((uint64_t)message->first_signal + message->signal_count > plan->signal_count) return 0;
+        if (message->multiplexor >= 0 && (size_t)message->multiplexor >= plan->signal_count) return 0;
+    }
+    for (size_t i = 0; i < plan->signal_count; i++) {
+        const DbcSignalPlan* signal = &plan->signals[i];
+        if (signal->name >= plan->strings_size || signal->unit >= plan->strings_size) return 0;
+        if (signal->byte >= CAN_MAX_DATA || signal->shift >= 64 || signal->end_byte > CAN_MAX_DATA) return 0;
+        if (signal->length == 0 || signal->length > 64 || signal->start_bit >= CAN_MAX_DATA * 8) return 0;
+    }
+    return 1;
+}
+
+// Reads a plan cached by dbc_plan_save, NULL if it is missing, damaged or for another DBC
+DbcPlan* dbc_plan_read(const char* path, uint64_t dbc_hash) {
+    MappedFile file;
+    if (mapped_file_open(&file, path, 1, MAPPED_ACCESS_NORMAL) != 0) return NULL;
+
+    PlanFileHeader header;
+    DbcPlan* plan = NULL;
+    if (file.size < sizeof(header)) goto done;
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, PLAN_MAGIC, sizeof(header.magic)) != 0 || header.version != PLAN_VERSION ||
+        header.message_size != sizeof(DbcMessagePlan) || header.signal_size != sizeof(DbcSignalPlan) ||
+        header.dbc_hash != dbc_hash || header.message_count > file.size || header.signal_count > file.size ||
+        header.strings_size > file.size) {
+        goto done;
+    }
+
+    size_t messages_size = header.message_count * sizeof(DbcMessagePlan);
+    size_t signals_size = header.signal_count * sizeof(DbcSignalPlan);
+    if (sizeof(header) + messages_size + signals_size + header.strings_size != file.size) goto done;
+
+    plan = calloc(1, sizeof(DbcPlan));
+    if (!plan) goto done;
+    plan->dbc_hash = dbc_hash;
+    plan->messages = malloc(messages_size ? messages_size : 1);
+    plan->signals = malloc(signals_size ? signals_size : 1);
+    plan->strings = malloc(header.strings_size ? header.strings_size : 1);
+    if (!plan->messages || !plan->signals || !plan->strings) {
+        dbc_plan_free(plan);
+        plan = NULL;
+        goto done;
+    }
+
+    const char* p = file.data + sizeof(header);
+    memcpy(plan->messages, p, messages_size);
+    memcpy(plan->signals, p + messages_size, signals_size);
+    memcpy(plan->strings, p + messages_size + signals_size, header.strings_size);
+    plan->message_count = header.message_count;
+    plan->signal_count = header.signal_count;
+    plan->strings_size = header.strings_size;
+
+    if (!plan_is_valid(plan)) {
+        dbc_plan_free(plan);
+        plan = NULL;
+    }
+
+done:
+    mapped_file_close(&file);
+    return plan;
+}
+
+// $XDG_CACHE_HOME/motec_log_generator (or ~/.cache/...), created if needed. NULL if there is none
+static char* cache_dir(void) {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char base[4096];
+    if (xdg && *xdg) {
+        snprintf(base, sizeof(base), "%s", xdg);
+    } else if (home && *home) {
+        snprintf(base, sizeof(base), "%s/.cache", home);
+    } else {
+        return NULL;
+    }
+
+    size_t len = strlen(base) + sizeof(CACHE_DIR_NAME) + 2;
+    char* dir = malloc(len);
+    if (!dir) return NULL;
+    snprintf(dir, len, "%s/%s", base, CACHE_DIR_NAME);
+
+    mkdir(base, 0700);
+    struct stat st;
+    if (mkdir(dir, 0700) != 0 && (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))) {
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+// Loads the plan for a DBC file. Plans are cached by the hash of the DBC's contents, so
+// converting more logs with the same DBC skips parsing it. NULL = bad
+DbcPlan* dbc_plan_load(const char* dbc_path) {
+    MappedFile file;
+    if (mapped_file_open(&file, dbc_path, 1, MAPPED_ACCESS_NORMAL) != 0) return NULL;
+
+    uint64_t hash = dbc_plan_hash(file.data, file.size);
+    char* dir = cache_dir();
+    char* path = NULL;
+    if (dir) {
+        size_t len = strlen(dir) + 32;
+        path = malloc(len);
+        if (path) snprintf(path, len, "%s/%016llx.plan", dir, (unsigned long long)hash);
+        free(dir);
+    }
+
+    DbcPlan* plan = path ? dbc_plan_read(path, hash) : NULL;
+    if (!plan) {
+        DbcDatabase* dbc = dbc_parse(file.data, file.size);
+        if (dbc) {
+            plan = dbc_plan_compile(dbc, hash);
+            dbc_free(dbc);
+        }
+        // the cache is only an optimisation, failing to write it is not an error
+        if (plan && path) dbc_plan_save(plan, path);
+    }
+
+    free(path);
+    mapped_file_close(&file);
+    return plan;
+}
+
+// Raw bits of a PLAN_BITWISE signal, sign extended when it is signed
+static uint64_t extract_bitwise(const DbcSignalPlan* signal, const uint8_t* payload) {
+    uint64_t raw = 0;
+    unsigned length = signal->length;
+    if (!(signal->flags & PLAN_BIG_ENDIAN)) {
+        for (unsigned i = 0; i < length; i++) {
+            unsigned b = signal->start_bit + i;
+            raw |= (uint64_t)((payload[b / 8] >> (b % 8)) & 1) << i;
+        }
+    } else {
+        // big endian signals run from the MSB towards higher bytes, sawtooth bit numbering
+        unsigned b = signal->start_bit;
+        for (unsigned i = length; i-- > 0; ) {
+            raw |= (uint64_t)((payload[b / 8] >> (b % 8)) & 1) << i;
+            b = b % 8 == 0 ? b + 15 : b - 1;
+        }
+    }
+    return (raw ^ signal->sign) - signal->sign;
+}
+
+static inline uint64_t load_window(const DbcSignalPlan* signal, const uint8_t* payload) {
+    uint64_t word;
+    memcpy(&word, payload + signal->byte, sizeof(word));
+    return signal->flags & PLAN_BIG_ENDIAN ? __builtin_bswap64(word) : word;
+}
+
+// Raw bits of signal, sign extended when it is signed. payload spans CAN_PAYLOAD_SIZE bytes
+uint64_t dbc_plan_raw(const DbcSignalPlan* signal, const uint8_t* payload) {
+    if (signal->flags & PLAN_BITWISE) return extract_bitwise(signal, payload);
+    return (((load_window(signal, payload) >> signal->shift) & signal->mask) ^ signal->sign) - signal->sign;
+}
+
+// One loop per byte order with everything hoisted out, the body is a load, a shift, a
+// mask and a multiply-add with no branches
+#define DEFINE_DECODE_WINDOW(name, swap)                                                   \
+    static void name(const DbcSignalPlan* signal, const uint8_t* payloads, size_t count,  \
+                     double* out) {                                                        \
+        const uint8_t* p = payloads + signal->byte;                                        \
+        const unsigned shift = signal->shift;                                              \
+        const uint64_t mask = signal->mask;                                                \
+        const uint64_t sign = signal->sign;                                                \
+        const double factor = signal->factor;                                              \
+        const double offset = signal->offset;                                              \
+        for (size_t i = 0; i < count; i++) {                                               \
+            uint64_t word;                                                                 \
+            memcpy(&word, p + i * CAN_PAYLOAD_SIZE, sizeof(word));                         \
+            int64_t raw = (int64_t)((((swap(word) >> shift) & mask) ^ sign) - sign);       \
+            out[i] = (double)raw * factor + offset;                                        \
+        }                                                                                  \
+    }
+
+#define NO_SWAP(x) (x)
+DEFINE_DECODE_WINDOW(decode_little_endian, NO_SWAP)
+DEFINE_DECODE_WINDOW(decode_big_endian, __builtin_bswap64)
+
+// Decodes signal from count payloads laid out CAN_PAYLOAD_SIZE bytes apart
+void dbc_plan_decode(const DbcSignalPlan* signal, const uint8_t* payloads, size_t count, double* out) {
+    if (signal->flags & PLAN_BITWISE) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t raw = extract_bitwise(signal, payloads + i * CAN_PAYLOAD_SIZE);
+            double x = (signal->flags & PLAN_SIGNED) ? (double)(int64_t)raw : (double)raw;
+            out[i] = x * signal->factor + signal->offset;
+        }
+    } else if (signal->flags & PLAN_BIG_ENDIAN) {
+        decode_big_endian(signal, payloads, count, out);
+    } else {
+        decode_little_endian(signal, payloads, count, out);
+    }
+}
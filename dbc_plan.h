@@ -0,0 +1,70 @@
+#ifndef DBC_PLAN_H
+#define DBC_PLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dbc.h"
+
+// Signal plan flags
+#define PLAN_BIG_ENDIAN 0x01 // the 8-byte window is byte swapped before shifting
+#define PLAN_BITWISE 0x02    // doesn't fit one window (or is unsigned 64-bit), extracted bit by bit
+#define PLAN_SIGNED 0x04
+
+// A signal compiled down to one load, shift and mask. The raw value is
+//   ((window(payload + byte) >> shift) & mask ^ sign) - sign
+// where window is an 8-byte little endian load, byte swapped for big endian
+// signals, and the physical value is raw * factor + offset
+typedef struct DbcSignalPlan {
+    uint64_t mask;
+    uint64_t sign; // the sign bit for signed signals, 0 otherwise
+    double factor;
+    double offset;
+    uint32_t name; // offsets into DbcPlan.strings
+    uint32_t unit;
+    uint32_t mux_value;
+    uint16_t byte;
+    uint16_t start_bit; // DBC numbering, only used by PLAN_BITWISE signals
+    uint8_t shift;
+    uint8_t length;
+    uint8_t flags;
+    uint8_t mux_type; // DbcMuxType
+    uint8_t end_byte; // payload bytes a frame needs to carry the signal
+    uint8_t decimals;
+    uint8_t reserved[2];
+} DbcSignalPlan;
+
+typedef struct DbcMessagePlan {
+    uint32_t id; // CAN_EXTENDED_FLAG set for extended IDs
+    uint32_t first_signal; // index into DbcPlan.signals
+    uint32_t signal_count;
+    int32_t multiplexor; // index into DbcPlan.signals, -1 if the message isn't multiplexed
+} DbcMessagePlan;
+
+// Every message of a DBC compiled for decoding. The arrays are flat so a plan can be
+// written to and read from the on-disk cache as is
+typedef struct DbcPlan {
+    uint64_t dbc_hash; // hash of the DBC file the plan was compiled from
+    DbcMessagePlan* messages;
+    size_t message_count;
+    DbcSignalPlan* signals;
+    size_t signal_count;
+    char* strings; // NUL terminated signal names and units
+    size_t strings_size;
+} DbcPlan;
+
+DbcPlan* dbc_plan_compile(const DbcDatabase* dbc, uint64_t dbc_hash);
+DbcPlan* dbc_plan_load(const char* dbc_path);
+void dbc_plan_free(DbcPlan* plan);
+
+uint64_t dbc_plan_hash(const char* data, size_t len);
+int dbc_plan_save(const DbcPlan* plan, const char* path);
+DbcPlan* dbc_plan_read(const char* path, uint64_t dbc_hash);
+
+uint64_t dbc_plan_raw(const DbcSignalPlan* signal, const uint8_t* payload);
+void dbc_plan_decode(const DbcSignalPlan* signal, const uint8_t* payloads, size_t count, double* out);
+
+static inline const char* dbc_plan_string(const DbcPlan* plan, uint32_t offset) {
+    return plan->strings + offset;
+}
+
+#endif
@@ -0,0 +1,518 @@
+#include "ld_codec.h"
+#include "ldparser.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LD_CODEC_X86 1
+#endif
+
+#define MAX_ENCODE_DECIMALS 9
+#define EXACT_TOLERANCE 1e-6 // fraction of one quantization step still treated as exact
+#define CHECK_BLOCK 256      // samples tested between early exits in the SIMD exactness check
+
+// Decoding is value = (raw * factor + shift) * mul, evaluated in double
+typedef struct DecodeScale {
+    double factor; // 10^-dec / scale
+    double shift;
+    double mul;
+    int identity;  // factor 1, shift 0, mul 1
+} DecodeScale;
+
+typedef void (*decode_fn)(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out);
+
+typedef struct CodecKernels {
+    int (*is_quantized)(const double* values, size_t count, double shift, double factor);
+    void (*encode_int16)(const double* values, size_t count, double shift, double factor, int16_t* out);
+    void (*encode_int32)(const double* values, size_t count, double shift, double factor, int32_t* out);
+    void (*encode_float16)(const double* values, size_t count, uint16_t* out);
+    void (*encode_float32)(const double* values, size_t count, float* out);
+    decode_fn decode_int16;
+    decode_fn decode_int32;
+    decode_fn decode_float16;
+    decode_fn decode_float32;
+} CodecKernels;
+
+// Round to nearest even float -> IEEE half, overflow goes to infinity
+uint16_t ld_float_to_half(float value) {
+    const uint32_t f32_infinity = 255u << 23;
+    const uint32_t f16_max = (127u + 16u) << 23;
+    const uint32_t denormal_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    uint16_t half;
+    if (f >= f16_max) {
+        half = f > f32_infinity ? 0x7e00 : 0x7c00;
+    } else if (f < (113u << 23)) {
+        // subnormal half, let the FPU do the rounding by adding a magic number
+        float magic, shifted;
+        memcpy(&magic, &denormal_magic, sizeof(magic));
+        memcpy(&shifted, &f, sizeof(shifted));
+        shifted += magic;
+        memcpy(&f, &shifted, sizeof(f));
+        half = (uint16_t)(f - denormal_magic);
+    } else {
+        uint32_t mantissa_odd = (f >> 13) & 1;
+        f += ((uint32_t)(15 - 127) << 23) + 0xfff;
+        f += mantissa_odd;
+        half = (uint16_t)(f >> 13);
+    }
+    return half | (uint16_t)(sign >> 16);
+}
+
+float ld_half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    if (exponent == 0) {
+        float magnitude = ldexpf((float)mantissa, -24);
+        return sign ? -magnitude : magnitude;
+    }
+
+    uint32_t bits;
+    if (exponent == 31) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Saturating conversion, the SIMD paths saturate the same way
+static inline int32_t quantize_int32(double x) {
+    x = nearbyint(x);
+    if (x < INT32_MIN) return INT32_MIN;
+    if (x > INT32_MAX) return INT32_MAX;
+    return (int32_t)x;
+}
+
+static inline int16_t quantize_int16(double x) {
+    int32_t raw = quantize_int32(x);
+    if (raw < INT16_MIN) return INT16_MIN;
+    if (raw > INT16_MAX) return INT16_MAX;
+    return (int16_t)raw;
+}
+
+// 1 if every (value - shift) * factor lands on an integer
+static int is_quantized_scalar(const double* values, size_t count, double shift, double factor) {
+    for (size_t i = 0; i < count; i++) {
+        double x = (values[i] - shift) * factor;
+        if (fabs(x - nearbyint(x)) > EXACT_TOLERANCE) return 0;
+    }
+    return 1;
+}
+
+static void encode_int16_scalar(const double* values, size_t count, double shift, double factor, int16_t* out) {
+    for (size_t i = 0; i < count; i++) out[i] = quantize_int16((values[i] - shift) * factor);
+}
+
+static void encode_int32_scalar(const double* values, size_t count, double shift, double factor, int32_t* out) {
+    for (size_t i = 0; i < count; i++) out[i] = quantize_int32((values[i] - shift) * factor);
+}
+
+static void encode_float16_scalar(const double* values, size_t count, uint16_t* out) {
+    for (size_t i = 0; i < count; i++) out[i] = ld_float_to_half((float)values[i]);
+}
+
+static void encode_float32_scalar(const double* values, size_t count, float* out) {
+    for (size_t i = 0; i < count; i++) out[i] = (float)values[i];
+}
+
+// Unscaled samples are converted directly so -0.0 keeps its sign, like the F16C path
+static inline float scale_sample(double x, const DecodeScale* scale) {
+    if (scale->identity) return (float)x;
+    return (float)((x * scale->factor + scale->shift) * scale->mul);
+}
+
+// raw may be unaligned (it usually points into a mapped file), so samples are loaded with memcpy
+#define DEFINE_DECODE_SCALAR(name, type, convert) \
+    static void name(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out) { \
+        for (size_t i = 0; i < count; i++) { \
+            type v; \
+            memcpy(&v, raw + i * sizeof(type), sizeof(type)); \
+            out[i] = scale_sample(convert(v), scale); \
+        } \
+    }
+
+#define AS_DOUBLE(v) ((double)(v))
+DEFINE_DECODE_SCALAR(decode_int16_scalar, int16_t, AS_DOUBLE)
+DEFINE_DECODE_SCALAR(decode_int32_scalar, int32_t, AS_DOUBLE)
+DEFINE_DECODE_SCALAR(decode_float16_scalar, uint16_t, ld_half_to_float)
+DEFINE_DECODE_SCALAR(decode_float32_scalar, float, AS_DOUBLE)
+
+#if defined(LD_CODEC_X86)
+#define ROUND_NEAREST (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+
+__attribute__((target("avx2")))
+static int is_quantized_avx2(const double* values, size_t count, double shift, double factor) {
+    const __m256d vshift = _mm256_set1_pd(shift);
+    const __m256d vfactor = _mm256_set1_pd(factor);
+    const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    const __m256d tolerance = _mm256_set1_pd(EXACT_TOLERANCE);
+
+    size_t i = 0;
+    while (i + 4 <= count) {
+        // errors are OR-ed over a block so the early exit only costs one test per block
+        __m256d over = _mm256_setzero_pd();
+        size_t end = i + CHECK_BLOCK < count ? i + CHECK_BLOCK : count;
+        for (; i + 4 <= end; i += 4) {
+            __m256d x = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(values + i), vshift), vfactor);
+            __m256d error = _mm256_and_pd(_mm256_sub_pd(x, _mm256_round_pd(x, ROUND_NEAREST)), abs_mask);
+            over = _mm256_or_pd(over, _mm256_cmp_pd(error, tolerance, _CMP_GT_OQ));
+        }
+        if (_mm256_movemask_pd(over)) return 0;
+    }
+    return is_quantized_scalar(values + i, count - i, shift, factor);
+}
+
+// cvtpd_epi32 returns INT32_MIN for anything out of range, so clamp first like quantize_int32
+__attribute__((target("avx2")))
+static inline __m128i quantize4_avx2(const double* values, __m256d shift, __m256d factor) {
+    const __m256d lo = _mm256_set1_pd((double)INT32_MIN);
+    const __m256d hi = _mm256_set1_pd((double)INT32_MAX);
+    __m256d x = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(values), shift), factor);
+    x = _mm256_min_pd(_mm256_max_pd(_mm256_round_pd(x, ROUND_NEAREST), lo), hi);
+    return _mm256_cvtpd_epi32(x);
+}
+
+__attribute__((target("avx2")))
+static void encode_int16_avx2(const double* values, size_t count, double shift, double factor, int16_t* out) {
+    const __m256d vshift = _mm256_set1_pd(shift);
+    const __m256d vfactor = _mm256_set1_pd(factor);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = quantize4_avx2(values + i, vshift, vfactor);
+        __m128i b = quantize4_avx2(values + i + 4, vshift, vfactor);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+    }
+    encode_int16_scalar(values + i, count - i, shift, factor, out + i);
+}
+
+__attribute__((target("avx2")))
+static void encode_int32_avx2(const double* values, size_t count, double shift, double factor, int32_t* out) {
+    const __m256d vshift = _mm256_set1_pd(shift);
+    const __m256d vfactor = _mm256_set1_pd(factor);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(out + i), quantize4_avx2(values + i, vshift, vfactor));
+    }
+    encode_int32_scalar(values + i, count - i, shift, factor, out + i);
+}
+
+__attribute__((target("avx2,f16c")))
+static void encode_float16_f16c(const double* values, size_t count, uint16_t* out) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm256_cvtpd_ps(_mm256_loadu_pd(values + i));
+        __m128 b = _mm256_cvtpd_ps(_mm256_loadu_pd(values + i + 4));
+        __m256 f = _mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1);
+        _mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+    encode_float16_scalar(values + i, count - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void encode_float32_avx2(const double* values, size_t count, float* out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd(values + i)));
+    }
+    encode_float32_scalar(values + i, count - i, out + i);
+}
+#endif
+
+#if defined(LD_CODEC_X86) && defined(__SSE2__)
+// Same arithmetic as scale_sample two lanes at a time, results are bit identical
+static inline __m128 scale4_sse2(__m128d lo, __m128d hi, const DecodeScale* scale) {
+    const __m128d factor = _mm_set1_pd(scale->factor);
+    const __m128d shift = _mm_set1_pd(scale->shift);
+    const __m128d mul = _mm_set1_pd(scale->mul);
+    lo = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(lo, factor), shift), mul);
+    hi = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(hi, factor), shift), mul);
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+static inline __m128 scale_int4_sse2(__m128i v, const DecodeScale* scale) {
+    return scale4_sse2(_mm_cvtepi32_pd(v), _mm_cvtepi32_pd(_mm_srli_si128(v, 8)), scale);
+}
+
+static void decode_int16_sse2(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(raw + i * 2));
+        // sign extend by unpacking each value into the top half of a 32 bit lane
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, scale_int4_sse2(lo, scale));
+        _mm_storeu_ps(out + i + 4, scale_int4_sse2(hi, scale));
+    }
+    decode_int16_scalar(raw + i * 2, count - i, scale, out + i);
+}
+
+static void decode_int32_sse2(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i, scale_int4_sse2(_mm_loadu_si128((const __m128i*)(raw + i * 4)), scale));
+    }
+    decode_int32_scalar(raw + i * 4, count - i, scale, out + i);
+}
+
+static void decode_float32_sse2(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 f = _mm_loadu_ps((const float*)(raw + i * 4));
+        _mm_storeu_ps(out + i, scale4_sse2(_mm_cvtps_pd(f), _mm_cvtps_pd(_mm_movehl_ps(f, f)), scale));
+    }
+    decode_float32_scalar(raw + i * 4, count - i, scale, out + i);
+}
+#endif
+
+#if defined(LD_CODEC_X86)
+__attribute__((target("avx2")))
+static inline __m128 scale4_avx2(__m256d x, const DecodeScale* scale) {
+    x = _mm256_mul_pd(x, _mm256_set1_pd(scale->factor));
+    x = _mm256_add_pd(x, _mm256_set1_pd(scale->shift));
+    x = _mm256_mul_pd(x, _mm256_set1_pd(scale->mul));
+    return _mm256_cvtpd_ps(x);
+}
+
+__attribute__((target("avx2")))
+static void decode_int16_avx2(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(raw + i * 2)));
+        _mm_storeu_ps(out + i, scale4_avx2(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), scale));
+        _mm_storeu_ps(out + i + 4, scale4_avx2(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), scale));
+    }
+    decode_int16_scalar(raw + i * 2, count - i, scale, out + i);
+}
+
+__attribute__((target("avx2")))
+static void decode_int32_avx2(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(raw + i * 4));
+        _mm_storeu_ps(out + i, scale4_avx2(_mm256_cvtepi32_pd(v), scale));
+    }
+    decode_int32_scalar(raw + i * 4, count - i, scale, out + i);
+}
+
+// half -> float is exact, so unscaled channels skip the double arithmetic entirely
+__attribute__((target("avx2,f16c")))
+static void decode_float16_f16c(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 f = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(raw + i * 2)));
+        if (scale->identity) {
+            _mm256_storeu_ps(out + i, f);
+            continue;
+        }
+        _mm_storeu_ps(out + i, scale4_avx2(_mm256_cvtps_pd(_mm256_castps256_ps128(f)), scale));
+        _mm_storeu_ps(out + i + 4, scale4_avx2(_mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)), scale));
+    }
+    decode_float16_scalar(raw + i * 2, count - i, scale, out + i);
+}
+
+__attribute__((target("avx2")))
+static void decode_float32_avx2(const uint8_t* raw, size_t count, const DecodeScale* scale, float* out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 f = _mm_loadu_ps((const float*)(raw + i * 4));
+        _mm_storeu_ps(out + i, scale4_avx2(_mm256_cvtps_pd(f), scale));
+    }
+    decode_float32_scalar(raw + i * 4, count - i, scale, out + i);
+}
+#endif
+
+static CodecKernels select_kernels(void) {
+    CodecKernels kernels = {
+        is_quantized_scalar, encode_int16_scalar, encode_int32_scalar,
+        encode_float16_scalar, encode_float32_scalar,
+        decode_int16_scalar, decode_int32_scalar, decode_float16_scalar, decode_float32_scalar
+    };
+#if defined(LD_CODEC_X86) && defined(__SSE2__)
+    kernels.decode_int16 = decode_int16_sse2;
+    kernels.decode_int32 = decode_int32_sse2;
+    kernels.decode_float32 = decode_float32_sse2;
+#endif
+#if defined(LD_CODEC_X86)
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.is_quantized = is_quantized_avx2;
+        kernels.encode_int16 = encode_int16_avx2;
+        kernels.encode_int32 = encode_int32_avx2;
+        kernels.encode_float32 = encode_float32_avx2;
+        kernels.decode_int16 = decode_int16_avx2;
+        kernels.decode_int32 = decode_int32_avx2;
+        kernels.decode_float32 = decode_float32_avx2;
+        if (__builtin_cpu_supports("f16c")) {
+            kernels.encode_float16 = encode_float16_f16c;
+            kernels.decode_float16 = decode_float16_f16c;
+        }
+    }
+#endif
+    return kernels;
+}
+
+// 1 if every value survives a round trip through float16 within tolerance
+static int fits_float16(const double* values, size_t count, double tolerance) {
+    for (size_t i = 0; i < count; i++) {
+        if (fabs(values[i]) > 65504.0) return 0;
+        double decoded = ld_half_to_float(ld_float_to_half((float)values[i]));
+        if (fabs(decoded - values[i]) > tolerance) return 0;
+    }
+    return 1;
+}
+
+// Picks the smallest dtype that holds values to within half a step of their
+// display precision, preferring int16 > float16 > int32 > float32. Integer
+// encodings use the fewest decimals that still represent every value exactly
+// (or decimals when none does), with an integer shift centring the range.
+// Empty channels and channels with NaN or infinity stay float32
+void ld_choose_encoding(const double* values, size_t count, int decimals, LdEncoding* encoding) {
+    encoding->dtype = DTYPE_FLOAT32;
+    encoding->shift = 0;
+    encoding->mul = 1;
+    encoding->scale = 1;
+    encoding->dec = 0;
+    if (count == 0) return;
+
+    double min = values[0], max = values[0];
+    int finite = 1;
+    for (size_t i = 0; i < count; i++) {
+        double v = values[i];
+        finite &= (v - v) == 0.0;
+        min = v < min ? v : min;
+        max = v > max ? v : max;
+    }
+    if (!finite) return;
+
+    if (decimals < 0) decimals = 0;
+    if (decimals > MAX_ENCODE_DECIMALS) decimals = MAX_ENCODE_DECIMALS;
+
+    CodecKernels kernels = select_kernels();
+
+    double shift = nearbyint((min + max) / 2);
+    if (shift < INT16_MIN) shift = INT16_MIN;
+    if (shift > INT16_MAX) shift = INT16_MAX;
+
+    int dec = decimals;
+    for (int k = 0; k < decimals; k++) {
+        if (kernels.is_quantized(values, count, shift, pow(10.0, k))) {
+            dec = k;
+            break;
+        }
+    }
+
+    double factor = pow(10.0, dec);
+    double raw_min = nearbyint((min - shift) * factor);
+    double raw_max = nearbyint((max - shift) * factor);
+
+    uint16_t dtype = DTYPE_FLOAT32;
+    if (raw_min >= INT16_MIN && raw_max <= INT16_MAX) {
+        dtype = DTYPE_INT16;
+    } else if (fits_float16(values, count, 0.5 * pow(10.0, -decimals))) {
+        encoding->dtype = DTYPE_FLOAT16;
+        return;
+    } else if (raw_min >= INT32_MIN && raw_max <= INT32_MAX) {
+        dtype = DTYPE_INT32;
+    } else {
+        return;
+    }
+
+    encoding->dtype = dtype;
+    encoding->shift = (int16_t)shift;
+    encoding->dec = (int16_t)dec;
+}
+
+// 1 if encoding, picked earlier for part of a channel, also stores these values to within
+// half a step of their display precision. Lets an appended channel keep its encoding
+int ld_encoding_holds(const double* values, size_t count, int decimals, const LdEncoding* encoding) {
+    if (encoding->dtype == DTYPE_FLOAT32) return 1;
+
+    if (decimals < 0) decimals = 0;
+    if (decimals > MAX_ENCODE_DECIMALS) decimals = MAX_ENCODE_DECIMALS;
+    double tolerance = 0.5 * pow(10.0, -decimals);
+    if (encoding->dtype == DTYPE_FLOAT16) return fits_float16(values, count, tolerance);
+
+    if (encoding->mul == 0 || encoding->scale == 0) return 0;
+    double shift = (double)encoding->shift * encoding->mul;
+    double factor = (double)encoding->scale * pow(10.0, encoding->dec) / encoding->mul;
+    double limit = encoding->dtype == DTYPE_INT16 ? INT16_MAX : INT32_MAX;
+    for (size_t i = 0; i < count; i++) {
+        double raw = (values[i] - shift) * factor;
+        // also false for NaN and infinity
+        if (!(fabs(raw) <= limit)) return 0;
+        if (fabs(nearbyint(raw) - raw) / fabs(factor) > tolerance + EXACT_TOLERANCE) return 0;
+    }
+    return 1;
+}
+
+// Encodes values as described by encoding into a new buffer of count samples, NULL = bad
+void* ld_encode_samples(const double* values, size_t count, const LdEncoding* encoding) {
+    void* out = malloc((count ? count : 1) * ld_sample_size(encoding->dtype));
+    if (!out) return NULL;
+
+    ld_encode_samples_into(values, count, encoding, out);
+    return out;
+}
+
+// Encodes values as described by encoding into out, which has room for count samples
+void ld_encode_samples_into(const double* values, size_t count, const LdEncoding* encoding, void* out) {
+    CodecKernels kernels = select_kernels();
+
+    // raw = (value / mul - shift) * scale * 10^dec, the inverse of what MoTeC applies.
+    // Float dtypes are stored as is, ld_choose_encoding leaves their scaling at identity
+    double shift = (double)encoding->shift * encoding->mul;
+    double factor = (double)encoding->scale * pow(10.0, encoding->dec) / encoding->mul;
+
+    switch (encoding->dtype) {
+        case DTYPE_INT16:
+            kernels.encode_int16(values, count, shift, factor, out);
+            break;
+        case DTYPE_INT32:
+            kernels.encode_int32(values, count, shift, factor, out);
+            break;
+        case DTYPE_FLOAT16:
+            kernels.encode_float16(values, count, out);
+            break;
+        default:
+            kernels.encode_float32(values, count, out);
+            break;
+    }
+}
+
+// Decodes count raw samples to physical values, (raw / scale * 10^-dec + shift) * mul.
+// raw may be unaligned, it usually points straight into a mapped .ld file
+void ld_decode_samples(const void* raw, size_t count, const LdEncoding* encoding, float* out) {
+    DecodeScale scale;
+    scale.factor = pow(10.0, -encoding->dec) / (encoding->scale ? encoding->scale : 1);
+    scale.shift = encoding->shift;
+    scale.mul = encoding->mul;
+    scale.identity = scale.factor == 1.0 && scale.shift == 0.0 && scale.mul == 1.0;
+
+    if (encoding->dtype == DTYPE_FLOAT32 && scale.identity) {
+        memcpy(out, raw, count * sizeof(float));
+        return;
+    }
+
+    CodecKernels kernels = select_kernels();
+    decode_fn decode;
+    switch (encoding->dtype) {
+        case DTYPE_INT16: decode = kernels.decode_int16; break;
+        case DTYPE_INT32: decode = kernels.decode_int32; break;
+        case DTYPE_FLOAT16: decode = kernels.decode_float16; break;
+        default: decode = kernels.decode_float32; break;
+    }
+    decode((const uint8_t*)raw, count, &scale, out);
+}
@@ -0,0 +1,26 @@
+#ifndef LD_CODEC_H
+#define LD_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// How a channel's samples are stored in a .ld file. MoTeC decodes a raw
+// sample as (raw / scale * 10^-dec + shift) * mul
+typedef struct LdEncoding {
+    uint16_t dtype; // one of the DTYPE_* constants in ldparser.h
+    int16_t shift;
+    int16_t mul;
+    int16_t scale;
+    int16_t dec;
+} LdEncoding;
+
+void ld_choose_encoding(const double* values, size_t count, int decimals, LdEncoding* encoding);
+int ld_encoding_holds(const double* values, size_t count, int decimals, const LdEncoding* encoding);
+void* ld_encode_samples(const double* values, size_t count, const LdEncoding* encoding);
+void ld_encode_samples_into(const double* values, size_t count, const LdEncoding* encoding, void* out);
+void ld_decode_samples(const void* raw, size_t count, const LdEncoding* encoding, float* out);
+
+uint16_t ld_float_to_half(float value);
+float ld_half_to_float(uint16_t half);
+
+#endif
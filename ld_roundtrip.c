@@ -0,0 +1,124 @@
+#include "ldparser.h"
+#include "mapped_file.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Round-trips .ld files through read_ldfile and write_ldfile and checks that the
+// rewritten bytes match the original. Arguments are .ld files or directories of them
+
+typedef struct RoundtripTotals {
+    size_t checked;
+    size_t failed;
+} RoundtripTotals;
+
+static int has_ld_extension(const char* name) {
+    size_t len = strlen(name);
+    return len > 3 && strcasecmp(name + len - 3, ".ld") == 0;
+}
+
+// Returns the offset of the first differing byte, or -1 if the files are identical
+static long long first_difference(const MappedFile* a, const MappedFile* b) {
+    size_t common = a->size < b->size ? a->size : b->size;
+    for (size_t i = 0; i < common; i++) {
+        if (a->data[i] != b->data[i]) return (long long)i;
+    }
+    return a->size == b->size ? -1 : (long long)common;
+}
+
+// 0 = identical, -1 = could not be read, written or compared, 1 = bytes differ
+static int roundtrip_file(const char* path, const char* temp_path) {
+    ldData* data = read_ldfile(path);
+    if (!data) {
+        printf("FAIL  %s: could not be parsed\n", path);
+        return -1;
+    }
+
+    int written = write_ldfile(temp_path, data);
+    free_lddata(data);
+    if (written != 0) {
+        printf("FAIL  %s: could not be written\n", path);
+        return -1;
+    }
+
+    MappedFile original, rewritten;
+    if (mapped_file_open(&original, path, 1, MAPPED_ACCESS_NORMAL) != 0) return -1;
+    if (mapped_file_open(&rewritten, temp_path, 1, MAPPED_ACCESS_NORMAL) != 0) {
+        mapped_file_close(&original);
+        return -1;
+    }
+
+    long long offset = first_difference(&original, &rewritten);
+    if (offset < 0) {
+        printf("ok    %s (%zu bytes)\n", path, original.size);
+    } else {
+        printf("FAIL  %s: differs at offset %lld (%zu bytes in, %zu out)\n",
+               path, offset, original.size, rewritten.size);
+    }
+
+    mapped_file_close(&original);
+    mapped_file_close(&rewritten);
+    return offset < 0 ? 0 : 1;
+}
+
+static void roundtrip_path(const char* path, const char* temp_path, RoundtripTotals* totals) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        printf("FAIL  %s: not found\n", path);
+        totals->checked++;
+        totals->failed++;
+        return;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        totals->checked++;
+        if (roundtrip_file(path, temp_path) != 0) totals->failed++;
+        return;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir) return;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        size_t len = strlen(path) + strlen(entry->d_name) + 2;
+        char* child = malloc(len);
+        if (!child) break;
+        snprintf(child, len, "%s/%s", path, entry->d_name);
+
+        if (stat(child, &st) == 0 && (S_ISDIR(st.st_mode) || has_ld_extension(entry->d_name))) {
+            roundtrip_path(child, temp_path, totals);
+        }
+        free(child);
+    }
+    closedir(dir);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: ld_roundtrip <file.ld|directory> [...]\n");
+        return 1;
+    }
+
+    char temp_path[] = "/tmp/ld_roundtrip_XXXXXX";
+    int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        printf("ERROR: Could not create a temporary file\n");
+        return 1;
+    }
+    close(fd);
+
+    RoundtripTotals totals = {0, 0};
+    for (int i = 1; i < argc; i++) {
+        roundtrip_path(argv[i], temp_path, &totals);
+    }
+    unlink(temp_path);
+
+    printf("\n%zu files checked, %zu failed\n", totals.checked, totals.failed);
+    return totals.failed == 0 ? 0 : 1;
+}
@@ -1,425 +1,493 @@
+#define _GNU_SOURCE // strptime
 #include "ldparser.h"
+#include "ld_codec.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/stat.h>
+
+// Record offsets follow the struct formats of the python ldparser:
+//   header   <I4xII20xI24xHHHI8sHHI4x16s16x16s16x64s64s64x64s64x1024xI66x64s126x64s64s
+//   event    <64s64s1024sH
+//   venue    <64s1034xH
+//   vehicle  <64s128xI32s32s
+//   channel  <IIII H HHH hhhh 32s8s12s40x
+#define LD_MARKER 0x40
+
+// 1 if [offset, offset + len) lies inside a buffer of size bytes
+static int in_bounds(size_t size, uint64_t offset, size_t len) {
+    return offset <= size && len <= size - offset;
+}
 
-// Helper function to decode strings
-char* decode_string(const char* bytes, size_t len) {
-    char* result = malloc(len + 1);
-    if (!result) return NULL;
-    
-    memcpy(result, bytes, len);
-    result[len] = '\0';
+static uint16_t get_u16(const uint8_t* p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void put_u16(uint8_t* p, uint16_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+// Copies a C string into a fixed width field, NUL padded
+static void put_string(uint8_t* p, const char* s, size_t len) {
+    size_t n = strnlen(s, len);
+    memcpy(p, s, n);
+    memset(p + n, 0, len - n);
+}
+
+// Copies a fixed width string field into out (out_size bytes, always NUL terminated),
+// stopping at the first NUL and trimming trailing spaces
+void decode_string(const char* bytes, size_t len, char* out, size_t out_size) {
+    if (out_size == 0) return;
     
-    // Trim trailing nulls and whitespace
-    size_t end = len;
-    while (end > 0 && (result[end-1] == '\0' || result[end-1] == ' '))
-        end--;
+    size_t end = 0;
+    while (end < len && end < out_size - 1 && bytes[end] != '\0') end++;
+    while (end > 0 && bytes[end-1] == ' ') end--;
     
-    result[end] = '\0';
-    return result;
+    memcpy(out, bytes, end);
+    out[end] = '\0';
 }
 
+#define DECODE_FIELD(out, p, len) decode_string((const char*)(p), (len), (out), sizeof(out))
+
 // Read vehicle information
-ldVehicle* read_vehicle(FILE* f) {
-    ldVehicle* vehicle = malloc(sizeof(ldVehicle));
-    if (!vehicle) return NULL;
+ldVehicle* read_vehicle(const uint8_t* data, size_t size, uint32_t offset) {
+    if (!in_bounds(size, offset, LD_VEHICLE_SIZE)) return NULL;
     
-    char id[64];
-    uint32_t weight;
-    char type[32];
-    char comment[32];
-    
-    if (fread(id, 64, 1, f) != 1 ||
-        fread(&weight, 4, 1, f) != 1 ||
-        fread(type, 32, 1, f) != 1 ||
-        fread(comment, 32, 1, f) != 1) {
-        free(vehicle);
-        return NULL;
-    }
+    ldVehicle* vehicle = calloc(1, sizeof(ldVehicle));
+    if (!vehicle) return NULL;
     
-    memcpy(vehicle->id, id, 64);
-    vehicle->weight = weight;
-    memcpy(vehicle->type, type, 32);
-    memcpy(vehicle->comment, comment, 32);
+    const uint8_t* p = data + offset;
+    DECODE_FIELD(vehicle->id, p, 64);
+    vehicle->weight = get_u32(p + 192);
+    DECODE_FIELD(vehicle->type, p + 196, 32);
+    DECODE_FIELD(vehicle->comment, p + 228, 32);
     
     return vehicle;
 }
 
 // Read venue information
-ldVenue* read_venue(FILE* f) {
-    ldVenue* venue = malloc(sizeof(ldVenue));
-    if (!venue) return NULL;
-    
-    char name[64];
-    uint16_t vehicle_ptr;
-    
-    if (fread(name, 64, 1, f) != 1 ||
-        fseek(f, 1034, SEEK_CUR) != 0 ||  // Skip 1034 bytes
-        fread(&vehicle_ptr, 2, 1, f) != 1) {
-        free(venue);
-        return NULL;
-    }
+ldVenue* read_venue(const uint8_t* data, size_t size, uint32_t offset) {
+    if (!in_bounds(size, offset, LD_VENUE_SIZE)) return NULL;
     
-    memcpy(venue->name, name, 64);
-    venue->vehicle_ptr = vehicle_ptr;
+    ldVenue* venue = calloc(1, sizeof(ldVenue));
+    if (!venue) return NULL;
     
-    if (vehicle_ptr > 0) {
-        long pos = ftell(f);
-        fseek(f, vehicle_ptr, SEEK_SET);
-        venue->vehicle = read_vehicle(f);
-        fseek(f, pos, SEEK_SET);
-    } else {
-        venue->vehicle = NULL;
-    }
+    const uint8_t* p = data + offset;
+    DECODE_FIELD(venue->name, p, 64);
+    venue->vehicle_ptr = get_u16(p + 1098);
+    venue->vehicle = venue->vehicle_ptr > 0 ? read_vehicle(data, size, venue->vehicle_ptr) : NULL;
     
     return venue;
 }
 
 // Read event information
-ldEvent* read_event(FILE* f) {
-    ldEvent* event = malloc(sizeof(ldEvent));
+ldEvent* read_event(const uint8_t* data, size_t size, uint32_t offset) {
+    if (!in_bounds(size, offset, LD_EVENT_SIZE)) return NULL;
+    
+    ldEvent* event = calloc(1, sizeof(ldEvent));
     if (!event) return NULL;
     
-    char name[64];
-    char session[64];
-    char comment[1024];
-    uint16_t venue_ptr;
+    const uint8_t* p = data + offset;
+    DECODE_FIELD(event->name, p, 64);
+    DECODE_FIELD(event->session, p + 64, 64);
+    DECODE_FIELD(event->comment, p + 128, 1024);
+    event->venue_ptr = get_u16(p + 1152);
+    event->venue = event->venue_ptr > 0 ? read_venue(data, size, event->venue_ptr) : NULL;
     
-    if (fread(name, 64, 1, f) != 1 ||
-        fread(session, 64, 1, f) != 1 ||
-        fread(comment, 1024, 1, f) != 1 ||
-        fread(&venue_ptr, 2, 1, f) != 1) {
-        free(event);
-        return NULL;
-    }
+    return event;
+}
+
+// Decodes the file header at offset 0 and the event, venue and vehicle records it links to
+ldHead* read_head(const uint8_t* data, size_t size) {
+    if (!in_bounds(size, 0, LD_HEAD_SIZE)) return NULL;
     
-    memcpy(event->name, name, 64);
-    memcpy(event->session, session, 64);
-    memcpy(event->comment, comment, 1024);
-    event->venue_ptr = venue_ptr;
+    ldHead* head = calloc(1, sizeof(ldHead));
+    if (!head) return NULL;
     
-    if (venue_ptr > 0) {
-        long pos = ftell(f);
-        fseek(f, venue_ptr, SEEK_SET);
-        event->venue = read_venue(f);
-        fseek(f, pos, SEEK_SET);
-    } else {
-        event->venue = NULL;
-    }
+    head->meta_ptr = get_u32(data + 8);
+    head->data_ptr = get_u32(data + 12);
+    head->event_ptr = get_u32(data + 36);
     
-    return event;
+    DECODE_FIELD(head->driver, data + 158, 64);
+    DECODE_FIELD(head->vehicleid, data + 222, 64);
+    DECODE_FIELD(head->venue, data + 350, 64);
+    DECODE_FIELD(head->short_comment, data + 1572, 64);
+    
+    head->device_serial = get_u32(data + 70);
+    DECODE_FIELD(head->device_type, data + 74, 8);
+    head->device_version = get_u16(data + 82);
+    head->pro_logging = get_u32(data + 1502);
+    
+    // Parse date/time
+    char date[17], time[17], datetime_str[34];
+    DECODE_FIELD(date, data + 94, 16);
+    DECODE_FIELD(time, data + 126, 16);
+    snprintf(datetime_str, sizeof(datetime_str), "%s %s", date, time);
+    strptime(datetime_str, "%d/%m/%Y %H:%M:%S", &head->datetime);
+    
+    // Read event data if present
+    head->event = head->event_ptr > 0 ? read_event(data, size, head->event_ptr) : NULL;
+    
+    return head;
 }
 
-// Main function to read an LD file
-ldData* read_ldfile(const char* filename) {
-    FILE* f = fopen(filename, "rb");
-    if (!f) return NULL;
-    
-    ldData* data = malloc(sizeof(ldData));
-    if (!data) {
-        fclose(f);
-        return NULL;
+// Decodes the channel record at meta_ptr, data is left NULL for read_ldfile to attach
+ldChan* read_channel(const uint8_t* data, size_t size, uint32_t meta_ptr) {
+    if (!in_bounds(size, meta_ptr, LD_CHAN_META_SIZE)) return NULL;
+    
+    ldChan* chan = calloc(1, sizeof(ldChan));
+    if (!chan) return NULL;
+    
+    const uint8_t* p = data + meta_ptr;
+    chan->meta_ptr = meta_ptr;
+    chan->prev_meta_ptr = get_u32(p);
+    chan->next_meta_ptr = get_u32(p + 4);
+    chan->data_ptr = get_u32(p + 8);
+    chan->data_len = get_u32(p + 12);
+    
+    // Set data type based on dtype_a and dtype
+    uint16_t dtype_a = get_u16(p + 18);
+    uint16_t dtype = get_u16(p + 20);
+    if (dtype_a == 0x07) {
+        chan->dtype = (dtype == 2) ? DTYPE_FLOAT16 : DTYPE_FLOAT32;
+    } else {
+        chan->dtype = (dtype == 2) ? DTYPE_INT16 : DTYPE_INT32;
     }
     
-    // Read header
-    data->head = read_head(f);
-    if (!data->head) {
-        free(data);
-        fclose(f);
-        return NULL;
-    }
+    chan->freq = get_u16(p + 22);
+    chan->shift = (int16_t)get_u16(p + 24);
+    chan->mul = (int16_t)get_u16(p + 26);
+    chan->scale = (int16_t)get_u16(p + 28);
+    chan->dec = (int16_t)get_u16(p + 30);
     
-    // Read channels
-    data->channs = read_channels(filename, data->head->meta_ptr, &data->chann_count);
-    if (!data->channs) {
-        free(data->head);
-        free(data);
-        fclose(f);
-        return NULL;
-    }
+    DECODE_FIELD(chan->name, p + 32, 32);
+    DECODE_FIELD(chan->short_name, p + 64, 8);
+    DECODE_FIELD(chan->unit, p + 72, 12);
     
-    fclose(f);
-    return data;
+    return chan;
 }
 
-// Free allocated memory
-void free_lddata(ldData* data) {
-    if (!data) return;
+// Walks the channel list from meta_ptr once. A list that runs out of bounds or
+// loops is cut where it goes wrong, NULL = bad (out of memory)
+ldChan** read_channels(const uint8_t* data, size_t size, uint32_t meta_ptr, size_t* count) {
+    // there can't be more records than fit in the file, which also stops cycles
+    size_t max_channels = size / LD_CHAN_META_SIZE;
+    size_t capacity = 64;
+    size_t n = 0;
+    ldChan** channels = malloc(sizeof(ldChan*) * capacity);
+    if (!channels) return NULL;
     
-    if (data->head) {
-        if (data->head->event) {
-            if (data->head->event->venue) {
-                if (data->head->event->venue->vehicle) {
-                    free(data->head->event->venue->vehicle);
-                }
-                free(data->head->event->venue);
-            }
-            free(data->head->event);
+    uint32_t current_ptr = meta_ptr;
+    while (current_ptr && n < max_channels) {
+        if (n == capacity) {
+            ldChan** grown = realloc(channels, sizeof(ldChan*) * capacity * 2);
+            if (!grown) break;
+            channels = grown;
+            capacity *= 2;
         }
-        free(data->head);
+        
+        ldChan* chan = read_channel(data, size, current_ptr);
+        if (!chan) break;
+        
+        channels[n++] = chan;
+        current_ptr = chan->next_meta_ptr;
     }
     
-    if (data->channs) {
-        for (size_t i = 0; i < data->chann_count; i++) {
-            if (data->channs[i]) {
-                free(data->channs[i]->data);
-                free(data->channs[i]->file_path);
-                free(data->channs[i]);
+    *count = n;
+    return channels;
+}
+
+// Bytes from the start of the file that write_ld_header fills: the header plus the
+// event, venue and vehicle records it links to
+size_t ld_header_extent(const ldHead* header) {
+    size_t extent = LD_HEAD_SIZE;
+    const ldEvent* event = header->event;
+    if (event) {
+        if ((size_t)header->event_ptr + LD_EVENT_SIZE > extent) extent = (size_t)header->event_ptr + LD_EVENT_SIZE;
+        if (event->venue) {
+            if ((size_t)event->venue_ptr + LD_VENUE_SIZE > extent) extent = (size_t)event->venue_ptr + LD_VENUE_SIZE;
+            if (event->venue->vehicle && (size_t)event->venue->vehicle_ptr + LD_VEHICLE_SIZE > extent) {
+                extent = (size_t)event->venue->vehicle_ptr + LD_VEHICLE_SIZE;
             }
         }
-        free(data->channs);
     }
-    
-    free(data);
+    return extent;
 }
-// Add to ldparser.c:
 
-ldHead* read_head(FILE* f) {
-    ldHead* head = malloc(sizeof(ldHead));
-    if (!head) return NULL;
+// Serializes the header and its event, venue and vehicle records into buffer, which
+// covers at least ld_header_extent bytes from the start of the file. Records are
+// written in that order, so a record placed over another (the stock layout puts the
+// vehicle over the header's event fields) wins like it does in MoTeC's files
+void write_ld_header(const ldHead* header, uint8_t* buffer, uint32_t channel_count) {
+    uint8_t* p = buffer;
+    memset(p, 0, LD_HEAD_SIZE);
+    
+    put_u32(p, LD_MARKER);
+    put_u32(p + 8, header->meta_ptr);
+    put_u32(p + 12, header->data_ptr);
+    put_u32(p + 36, header->event_ptr);
+    
+    put_u16(p + 64, 1);
+    put_u16(p + 66, 0x4240);
+    put_u16(p + 68, 0xf);
+    put_u32(p + 70, header->device_serial);
+    put_string(p + 74, header->device_type, 8);
+    put_u16(p + 82, header->device_version);
+    put_u16(p + 84, 0xadb0);
+    put_u32(p + 86, channel_count);
+    
+    char date[17], time[17];
+    if (strftime(date, sizeof(date), "%d/%m/%Y", &header->datetime) == 0) date[0] = '\0';
+    if (strftime(time, sizeof(time), "%H:%M:%S", &header->datetime) == 0) time[0] = '\0';
+    put_string(p + 94, date, 16);
+    put_string(p + 126, time, 16);
+    
+    put_string(p + 158, header->driver, 64);
+    put_string(p + 222, header->vehicleid, 64);
+    put_string(p + 350, header->venue, 64);
+    put_u32(p + 1502, header->pro_logging);
+    put_string(p + 1572, header->short_comment, 64);
+    
+    const ldEvent* event = header->event;
+    if (!event) return;
+    
+    put_string(p + 1762, event->name, 64);
+    put_string(p + 1826, event->session, 64);
+    
+    p = buffer + header->event_ptr;
+    memset(p, 0, LD_EVENT_SIZE);
+    put_string(p, event->name, 64);
+    put_string(p + 64, event->session, 64);
+    put_string(p + 128, event->comment, 1024);
+    put_u16(p + 1152, event->venue_ptr);
+    
+    const ldVenue* venue = event->venue;
+    if (!venue) return;
+    
+    p = buffer + event->venue_ptr;
+    memset(p, 0, LD_VENUE_SIZE);
+    put_string(p, venue->name, 64);
+    put_u16(p + 1098, venue->vehicle_ptr);
+    
+    const ldVehicle* vehicle = venue->vehicle;
+    if (!vehicle) return;
+    
+    p = buffer + venue->vehicle_ptr;
+    memset(p, 0, LD_VEHICLE_SIZE);
+    put_string(p, vehicle->id, 64);
+    put_u32(p + 192, vehicle->weight);
+    put_string(p + 196, vehicle->type, 32);
+    put_string(p + 228, vehicle->comment, 32);
+}
 
-    // Read marker and validate
-    uint32_t ldmarker;
-    if (fread(&ldmarker, sizeof(uint32_t), 1, f) != 1) {
-        free(head);
-        return NULL;
-    }
-    fseek(f, 4, SEEK_CUR); // Skip 4x padding
+// Serializes a channel record into the LD_CHAN_META_SIZE bytes at buffer
+void write_ld_channel(const ldChan* channel, uint8_t* buffer, int channel_index) {
+    uint8_t* p = buffer;
+    memset(p, 0, LD_CHAN_META_SIZE);
+    
+    put_u32(p, channel->prev_meta_ptr);
+    put_u32(p + 4, channel->next_meta_ptr);
+    put_u32(p + 8, channel->data_ptr);
+    put_u32(p + 12, channel->data_len);
+    
+    put_u16(p + 16, (uint16_t)(0x2ee1 + channel_index));
+    put_u16(p + 18, (channel->dtype == DTYPE_FLOAT32 || channel->dtype == DTYPE_FLOAT16) ? 0x07 : 0x00);
+    put_u16(p + 20, (uint16_t)ld_sample_size(channel->dtype));
+    put_u16(p + 22, channel->freq);
+    put_u16(p + 24, (uint16_t)channel->shift);
+    put_u16(p + 26, (uint16_t)channel->mul);
+    put_u16(p + 28, (uint16_t)channel->scale);
+    put_u16(p + 30, (uint16_t)channel->dec);
+    
+    put_string(p + 32, channel->name, 32);
+    put_string(p + 64, channel->short_name, 8);
+    put_string(p + 72, channel->unit, 12);
+}
 
-    // Read pointers
-    if (fread(&head->meta_ptr, sizeof(uint32_t), 1, f) != 1 ||
-        fread(&head->data_ptr, sizeof(uint32_t), 1, f) != 1) {
-        free(head);
-        return NULL;
+// Writes data back out as a .ld file. Every record goes to the offset it carries and
+// samples are copied as they are encoded, so rewriting a parsed file reproduces it
+// byte for byte and editing metadata never touches sample data. filename must not
+// be the file data was read from, its samples are still mapped. 0 = good, -1 = bad
+int write_ldfile(const char* filename, ldData* data) {
+    if (!filename || !data || !data->head) return -1;
+    
+    struct stat source, target;
+    if (data->file_path && stat(data->file_path, &source) == 0 && stat(filename, &target) == 0 &&
+        source.st_dev == target.st_dev && source.st_ino == target.st_ino) {
+        return -1;
     }
-
-    fseek(f, 20, SEEK_CUR); // Skip 20x padding
     
-    uint32_t event_ptr;
-    if (fread(&event_ptr, sizeof(uint32_t), 1, f) != 1) {
-        free(head);
-        return NULL;
-    }
-
-    fseek(f, 24, SEEK_CUR); // Skip 24x padding
-
-    // Skip static numbers
-    uint16_t static_nums[3];
-    fseek(f, sizeof(uint16_t) * 3, SEEK_CUR);
-
-    // Skip device info
-    fseek(f, 4 + 8 + 2 + 2, SEEK_CUR);
-
-    // Skip num_channs
-    uint32_t num_channs;
-    fseek(f, 4, SEEK_CUR);
+    size_t extent = ld_header_extent(data->head);
+    uint8_t* buffer = malloc(extent);
+    if (!buffer) return -1;
+    memset(buffer, 0, extent);
+    write_ld_header(data->head, buffer, (uint32_t)data->chann_count);
     
-    fseek(f, 4, SEEK_CUR); // Skip 4x padding
-
-    // Read date/time
-    char date[16], time[16];
-    if (fread(date, 16, 1, f) != 1) {
-        free(head);
-        return NULL;
+    FILE* f = fopen(filename, "wb");
+    if (!f) {
+        free(buffer);
+        return -1;
     }
-    fseek(f, 16, SEEK_CUR); // Skip 16x padding
     
-    if (fread(time, 16, 1, f) != 1) {
-        free(head);
-        return NULL;
+    int result = fwrite(buffer, 1, extent, f) == extent ? 0 : -1;
+    free(buffer);
+    
+    for (size_t i = 0; i < data->chann_count && result == 0; i++) {
+        const ldChan* chan = data->channs[i];
+        uint8_t record[LD_CHAN_META_SIZE];
+        write_ld_channel(chan, record, (int)i);
+        
+        if (fseek(f, chan->meta_ptr, SEEK_SET) != 0 || fwrite(record, 1, sizeof(record), f) != sizeof(record)) {
+            result = -1;
+        }
+        if (result == 0 && chan->data && chan->data_len > 0 &&
+            (fseek(f, chan->data_ptr, SEEK_SET) != 0 ||
+             fwrite(chan->data, ld_sample_size(chan->dtype), chan->data_len, f) != chan->data_len)) {
+            result = -1;
+        }
     }
-    fseek(f, 16, SEEK_CUR); // Skip 16x padding
+    
+    if (fclose(f) != 0) result = -1;
+    return result;
+}
 
-    // Read strings
-    char driver[64], vehicleid[64], venue[64];
-    if (fread(driver, 64, 1, f) != 1 ||
-        fread(vehicleid, 64, 1, f) != 1) {
-        free(head);
-        return NULL;
+// Points each channel at its samples inside the mapping, leaving data NULL for
+// channels whose data region doesn't fit in the file
+static void attach_channel_data(ldData* data) {
+    for (size_t i = 0; i < data->chann_count; i++) {
+        ldChan* chan = data->channs[i];
+        uint64_t end = (uint64_t)chan->data_ptr + (uint64_t)chan->data_len * ld_sample_size(chan->dtype);
+        if (end <= data->file.size) {
+            chan->data = (void*)(data->file.data + chan->data_ptr);
+        }
     }
+}
+
+// Main function to read an LD file. The file is mapped once, metadata is decoded
+// straight from the mapping, and samples are decoded on demand by ld_channel_values
+ldData* read_ldfile(const char* filename) {
+    ldData* data = calloc(1, sizeof(ldData));
+    if (!data) return NULL;
     
-    fseek(f, 64, SEEK_CUR); // Skip 64x padding
-    
-    if (fread(venue, 64, 1, f) != 1) {
-        free(head);
+    if (mapped_file_open(&data->file, filename, 1, MAPPED_ACCESS_NORMAL) != 0) {
+        free(data);
         return NULL;
     }
-
-    fseek(f, 64, SEEK_CUR); // Skip 64x padding
-    fseek(f, 1024, SEEK_CUR); // Skip 1024x padding
-
-    // Skip pro logging
-    fseek(f, 4, SEEK_CUR);
-    fseek(f, 66, SEEK_CUR); // Skip 66x padding
-
-    // Read comments and event info
-    char short_comment[64], event[64], session[64];
-    if (fread(short_comment, 64, 1, f) != 1) {
-        free(head);
+    
+    const uint8_t* bytes = (const uint8_t*)data->file.data;
+    data->file_path = strdup(filename);
+    data->head = read_head(bytes, data->file.size);
+    if (!data->file_path || !data->head) {
+        free_lddata(data);
         return NULL;
     }
     
-    fseek(f, 126, SEEK_CUR); // Skip 126x padding
-    
-    if (fread(event, 64, 1, f) != 1 ||
-        fread(session, 64, 1, f) != 1) {
-        free(head);
+    data->channs = read_channels(bytes, data->file.size, data->head->meta_ptr, &data->chann_count);
+    if (!data->channs) {
+        free_lddata(data);
         return NULL;
     }
-
-    // Copy strings
-    strncpy(head->driver, decode_string(driver, 64), 64);
-    strncpy(head->vehicleid, decode_string(vehicleid, 64), 64);
-    strncpy(head->venue, decode_string(venue, 64), 64);
-    strncpy(head->short_comment, decode_string(short_comment, 64), 64);
-
-    // Parse date/time
-    char datetime_str[33];
-    snprintf(datetime_str, sizeof(datetime_str), "%s %s", 
-             decode_string(date, 16), decode_string(time, 16));
-    strptime(datetime_str, "%d/%m/%Y %H:%M:%S", &head->datetime);
-
-    // Read auxiliary event data if present
-    head->aux_ptr = event_ptr;
-    if (event_ptr > 0) {
-        fseek(f, event_ptr, SEEK_SET);
-        head->aux = read_event(f);
-    } else {
-        head->aux = NULL;
+    
+    for (size_t i = 0; i < data->chann_count; i++) {
+        data->channs[i]->file_path = data->file_path;
     }
-
-    return head;
+    attach_channel_data(data);
+    
+    return data;
 }
 
-ldChan** read_channels(const char* filename, uint32_t meta_ptr, size_t* count) {
-    FILE* f = fopen(filename, "rb");
-    if (!f) return NULL;
-
-    // Count channels first
-    size_t num_channels = 0;
-    uint32_t current_ptr = meta_ptr;
-    
-    while (current_ptr) {
-        fseek(f, current_ptr, SEEK_SET);
-        
-        uint32_t next_ptr;
-        if (fread(&next_ptr, sizeof(uint32_t), 1, f) != 1) {
-            fclose(f);
-            return NULL;
-        }
-        
-        num_channels++;
-        current_ptr = next_ptr;
+// Returns channel index's physical values, decoding them on first use. With
+// allow_view a plain float32 channel is returned as a view of the mapping
+// instead of a copy. The result lives until free_lddata. Not thread safe,
+// NULL = bad (index out of range, truncated file, out of memory)
+const float* ld_channel_values(ldData* data, size_t index, int allow_view) {
+    if (!data || index >= data->chann_count) return NULL;
+    
+    ldChan* chan = data->channs[index];
+    if (chan->values) return chan->values;
+    if (!chan->data) return NULL;
+    
+    int identity = chan->shift == 0 && chan->mul == 1 && chan->scale == 1 && chan->dec == 0;
+    if (allow_view && chan->dtype == DTYPE_FLOAT32 && identity &&
+        (uintptr_t)chan->data % _Alignof(float) == 0) {
+        chan->values = (float*)chan->data;
+        return chan->values;
     }
+    
+    float* values = malloc((chan->data_len ? chan->data_len : 1) * sizeof(float));
+    if (!values) return NULL;
+    
+    LdEncoding encoding = {chan->dtype, chan->shift, chan->mul, chan->scale, chan->dec};
+    ld_decode_samples(chan->data, chan->data_len, &encoding, values);
+    chan->values = values;
+    return values;
+}
 
-    // Allocate channel array
-    ldChan** channels = malloc(sizeof(ldChan*) * num_channels);
-    if (!channels) {
-        fclose(f);
+// Reads and decodes a channel's samples with stdio, for callers that only have an
+// open file. The caller frees the result, NULL = bad
+float* read_channel_data(FILE* f, ldChan* chan) {
+    if (!f || !chan) return NULL;
+    
+    size_t raw_size = (size_t)chan->data_len * ld_sample_size(chan->dtype);
+    void* raw = malloc(raw_size ? raw_size : 1);
+    float* values = malloc((chan->data_len ? chan->data_len : 1) * sizeof(float));
+    if (!raw || !values ||
+        fseek(f, chan->data_ptr, SEEK_SET) != 0 ||
+        fread(raw, 1, raw_size, f) != raw_size) {
+        free(raw);
+        free(values);
         return NULL;
     }
-
-    // Read each channel
-    current_ptr = meta_ptr;
-    size_t idx = 0;
     
-    while (current_ptr && idx < num_channels) {
-        fseek(f, current_ptr, SEEK_SET);
-        
-        ldChan* chan = malloc(sizeof(ldChan));
-        if (!chan) {
-            // Cleanup on error
-            for (size_t i = 0; i < idx; i++) {
-                free(channels[i]);
-            }
-            free(channels);
-            fclose(f);
-            return NULL;
-        }
-
-        chan->file_path = strdup(filename);
-        chan->meta_ptr = current_ptr;
-
-        // Read channel metadata
-        if (fread(&chan->prev_meta_ptr, sizeof(uint32_t), 1, f) != 1 ||
-            fread(&chan->next_meta_ptr, sizeof(uint32_t), 1, f) != 1 ||
-            fread(&chan->data_ptr, sizeof(uint32_t), 1, f) != 1 ||
-            fread(&chan->data_len, sizeof(uint32_t), 1, f) != 1) {
-            free(chan);
-            for (size_t i = 0; i < idx; i++) {
-                free(channels[i]);
-            }
-            free(channels);
-            fclose(f);
-            return NULL;
-        }
-
-        // Skip counter
-        fseek(f, 2, SEEK_CUR);
-
-        // Read data type info
-        uint16_t dtype_a, dtype;
-        if (fread(&dtype_a, sizeof(uint16_t), 1, f) != 1 ||
-            fread(&dtype, sizeof(uint16_t), 1, f) != 1) {
-            free(chan);
-            for (size_t i = 0; i < idx; i++) {
-                free(channels[i]);
-            }
-            free(channels);
-            fclose(f);
-            return NULL;
-        }
-
-        // Set data type based on dtype_a and dtype
-        if (dtype_a == 0x07) {
-            chan->dtype = (dtype == 2) ? DTYPE_FLOAT16 : DTYPE_FLOAT32;
-        } else {
-            chan->dtype = (dtype == 2) ? DTYPE_INT16 : DTYPE_INT32;
-        }
+    LdEncoding encoding = {chan->dtype, chan->shift, chan->mul, chan->scale, chan->dec};
+    ld_decode_samples(raw, chan->data_len, &encoding, values);
+    free(raw);
+    return values;
+}
 
-        // Read remaining metadata
-        if (fread(&chan->freq, sizeof(uint16_t), 1, f) != 1 ||
-            fread(&chan->shift, sizeof(int16_t), 1, f) != 1 ||
-            fread(&chan->mul, sizeof(int16_t), 1, f) != 1 ||
-            fread(&chan->scale, sizeof(int16_t), 1, f) != 1 ||
-            fread(&chan->dec, sizeof(int16_t), 1, f) != 1) {
-            free(chan);
-            for (size_t i = 0; i < idx; i++) {
-                free(channels[i]);
+// Free allocated memory
+void free_lddata(ldData* data) {
+    if (!data) return;
+    
+    if (data->head) {
+        if (data->head->event) {
+            if (data->head->event->venue) {
+                if (data->head->event->venue->vehicle) {
+                    free(data->head->event->venue->vehicle);
+                }
+                free(data->head->event->venue);
             }
-            free(channels);
-            fclose(f);
-            return NULL;
+            free(data->head->event);
         }
-
-        // Read strings
-        char name[32], short_name[8], unit[12];
-        if (fread(name, 32, 1, f) != 1 ||
-            fread(short_name, 8, 1, f) != 1 ||
-            fread(unit, 12, 1, f) != 1) {
-            free(chan);
-            for (size_t i = 0; i < idx; i++) {
-                free(channels[i]);
+        free(data->head);
+    }
+    
+    if (data->channs) {
+        for (size_t i = 0; i < data->chann_count; i++) {
+            if (data->channs[i]) {
+                // data points into the mapping, values too when it is a view
+                if (data->channs[i]->values != data->channs[i]->data) {
+                    free(data->channs[i]->values);
+                }
+                free(data->channs[i]);
             }
-            free(channels);
-            fclose(f);
-            return NULL;
         }
-
-        // Copy strings
-        strncpy(chan->name, decode_string(name, 32), 32);
-        strncpy(chan->short_name, decode_string(short_name, 8), 8);
-        strncpy(chan->unit, decode_string(unit, 12), 12);
-
-        // Initialize data pointer
-        chan->data = NULL;
-
-        channels[idx++] = chan;
-        current_ptr = chan->next_meta_ptr;
+        free(data->channs);
     }
-
-    *count = num_channels;
-    fclose(f);
-    return channels;
-}
\ No newline at end of file
+    
+    mapped_file_close(&data->file);
+    free(data->file_path);
+    free(data);
+}
@@ -4,6 +4,24 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <time.h>
+#include "mapped_file.h"
+
+// Data type constants
+#define DTYPE_FLOAT32 1
+#define DTYPE_FLOAT16 2
+#define DTYPE_INT32 3
+#define DTYPE_INT16 4
+
+// On-disk record sizes
+#define LD_HEAD_SIZE 1890
+#define LD_EVENT_SIZE 1154
+#define LD_VENUE_SIZE 1100
+#define LD_VEHICLE_SIZE 260
+#define LD_CHAN_META_SIZE 124
+
+static inline size_t ld_sample_size(uint16_t dtype) {
+    return (dtype == DTYPE_FLOAT16 || dtype == DTYPE_INT16) ? 2 : 4;
+}
 
 // Forward declarations
 struct ldVehicle;
@@ -45,12 +63,19 @@ typedef struct ldHead {
     char venue[64];
     struct tm datetime;
     char short_comment[64];
+    
+    // logger device, copied through unchanged on a rewrite
+    uint32_t device_serial;
+    char device_type[8];
+    uint16_t device_version;
+    uint32_t pro_logging;
 } ldHead;
 
 typedef struct ldChan {
-    char* file_path;
+    char* file_path; // shared with the owning ldData, not freed per channel
     uint32_t meta_ptr;
-    float* data;
+    void* data; // samples encoded as dtype, read from the file's mapping when parsed
+    float* values; // decoded samples, filled on first access (may point into the mapping)
     
     uint32_t prev_meta_ptr;
     uint32_t next_meta_ptr;
@@ -73,23 +98,33 @@ typedef struct ldData {
     ldHead* head;
     ldChan** channs;
     size_t chann_count;
+    MappedFile file; // the whole .ld file, channel data points into it
+    char* file_path;
 } ldData;
 
 // Function declarations
 ldData* read_ldfile(const char* filename);
 void free_lddata(ldData* data);
 
-ldVehicle* read_vehicle(FILE* f);
-ldVenue* read_venue(FILE* f);
-ldEvent* read_event(FILE* f);
-ldHead* read_head(FILE* f);
-ldChan* read_channel(const char* filename, uint32_t meta_ptr);
-ldChan** read_channels(const char* filename, uint32_t meta_ptr, size_t* count);
+// Record decoders, each reads from an in-memory copy of the file of size bytes
+ldVehicle* read_vehicle(const uint8_t* data, size_t size, uint32_t offset);
+ldVenue* read_venue(const uint8_t* data, size_t size, uint32_t offset);
+ldEvent* read_event(const uint8_t* data, size_t size, uint32_t offset);
+ldHead* read_head(const uint8_t* data, size_t size);
+ldChan* read_channel(const uint8_t* data, size_t size, uint32_t meta_ptr);
+ldChan** read_channels(const uint8_t* data, size_t size, uint32_t meta_ptr, size_t* count);
+
+int write_ldfile(const char* filename, ldData* data);
+
+// Record serializers shared by write_ldfile and the MotecLog writer
+size_t ld_header_extent(const ldHead* header);
+void write_ld_header(const ldHead* header, uint8_t* buffer, uint32_t channel_count);
+void write_ld_channel(const ldChan* channel, uint8_t* buffer, int channel_index);
 
-void write_ldfile(const char* filename, ldData* data);
+const float* ld_channel_values(ldData* data, size_t index, int allow_view);
 
 // Helper functions
-char* decode_string(const char* bytes, size_t len);
+void decode_string(const char* bytes, size_t len, char* out, size_t out_size);
 float* read_channel_data(FILE* f, ldChan* chan);
 
 #endif // LDPARSER_H
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "mapped_file.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define READ_CHUNK_SIZE (1 << 20)
+
+// Reads everything left in fd into a heap buffer, 0 = good, -1 = bad
+static int read_fd(MappedFile* file, int fd) {
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t size = 0;
+    char* buffer = malloc(capacity);
+    if (!buffer) return -1;
+
+    for (;;) {
+        if (capacity - size < READ_CHUNK_SIZE) {
+            char* grown = realloc(buffer, capacity * 2);
+            if (!grown) {
+                free(buffer);
+                return -1;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+
+        ssize_t n = read(fd, buffer + size, capacity - size);
+        if (n < 0) {
+            free(buffer);
+            return -1;
+        }
+        if (n == 0) break;
+        size += (size_t)n;
+    }
+
+    file->data = buffer;
+    file->size = size;
+    file->is_mapped = 0;
+    return 0;
+}
+
+// Opens path as a MappedFile, access tells the kernel how much to read ahead. 0 = good, -1 = bad
+int mapped_file_open(MappedFile* file, const char* path, int allow_mmap, MappedAccess access) {
+    memset(file, 0, sizeof(MappedFile));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // mmap only works for regular files, and an empty file can't be mapped
+    if (allow_mmap && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            close(fd);
+            file->data = data;
+            file->size = (size_t)st.st_size;
+            file->is_mapped = 1;
+            mapped_file_advise(file, access);
+            return 0;
+        }
+    }
+
+    int result = read_fd(file, fd);
+    close(fd);
+    return result;
+}
+
+// Buffers the rest of an already open stream, 0 = good, -1 = bad
+int mapped_file_read_stream(MappedFile* file, FILE* f) {
+    memset(file, 0, sizeof(MappedFile));
+    if (!f) return -1;
+
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t size = 0;
+    char* buffer = malloc(capacity);
+    if (!buffer) return -1;
+
+    size_t n;
+    while ((n = fread(buffer + size, 1, capacity - size, f)) > 0) {
+        size += n;
+        if (size == capacity) {
+            char* grown = realloc(buffer, capacity * 2);
+            if (!grown) {
+                free(buffer);
+                return -1;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+    }
+
+    file->data = buffer;
+    file->size = size;
+    file->is_mapped = 0;
+    return 0;
+}
+
+// Tells the kernel how the mapping will be read from now on. Sequential reads ahead
+// aggressively and drops pages behind, which only pays off for a single pass, random
+// reads only the pages touched. Reading a few channels of an .ld keeps the default
+void mapped_file_advise(const MappedFile* file, MappedAccess access) {
+    if (!file->is_mapped) return;
+
+    int advice = access == MAPPED_ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL
+               : access == MAPPED_ACCESS_RANDOM ? MADV_RANDOM : MADV_NORMAL;
+    madvise((void*)file->data, file->size, advice);
+}
+
+// Lets the kernel drop mapped pages before offset, they are read back from the file if touched again.
+// Keeps a single forward pass over a huge file from holding it all in memory
+void mapped_file_discard(const MappedFile* file, size_t offset) {
+    if (!file->is_mapped) return;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = offset / page * page;
+    if (length > file->size) length = file->size / page * page;
+    if (length > 0) madvise((void*)file->data, length, MADV_DONTNEED);
+}
+
+void mapped_file_close(MappedFile* file) {
+    if (!file || !file->data) return;
+
+    if (file->is_mapped) {
+        munmap((void*)file->data, file->size);
+    } else {
+        free((void*)file->data);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Read-only view of a whole input file. Regular files are memory mapped,
+// anything else (pipes, sockets, ttys) is read into a heap buffer.
+typedef struct MappedFile {
+    const char* data;
+    size_t size;
+    int is_mapped; // 1 if data is an mmap view, 0 if it is a heap buffer
+} MappedFile;
+
+// How a mapping will be read, passed on to the kernel as readahead advice
+typedef enum {
+    MAPPED_ACCESS_NORMAL,     // default readahead, for files read in pieces (.ld channels, DBCs)
+    MAPPED_ACCESS_SEQUENTIAL, // one forward pass over the whole file (CSV and CAN log ingest)
+    MAPPED_ACCESS_RANDOM      // a few pages here and there, no readahead (the tails --append compares)
+} MappedAccess;
+
+int mapped_file_open(MappedFile* file, const char* path, int allow_mmap, MappedAccess access);
+int mapped_file_read_stream(MappedFile* file, FILE* f);
+void mapped_file_advise(const MappedFile* file, MappedAccess access);
+void mapped_file_discard(const MappedFile* file, size_t offset);
+void mapped_file_close(MappedFile* file);
+
+#endif
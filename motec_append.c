@@ -0,0 +1,364 @@
+#include "motec_append.h"
+#include "stats.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define COMPARE_BLOCK 4096 // bytes of old and new samples compared at a time
+#define COMPARE_TAIL 4096 // samples at the end of a region read back before the rest is trusted
+
+// Where channel i goes in the file and which of its bytes have to be written
+typedef struct AppendSlot {
+    uint64_t write_from; // bytes at the start of the data region that are already on disk
+} AppendSlot;
+
+// Bytes a data region is given when it is placed: its samples plus room to grow
+static uint64_t region_capacity(const ldChan* chan) {
+    uint64_t samples = (uint64_t)chan->data_len + chan->data_len / 2 + APPEND_MIN_SLACK;
+    return samples * ld_sample_size(chan->dtype);
+}
+
+static uint64_t region_size(const ldChan* chan) {
+    return (uint64_t)chan->data_len * ld_sample_size(chan->dtype);
+}
+
+static int same_encoding(const ldChan* a, const ldChan* b) {
+    return a->dtype == b->dtype && a->shift == b->shift && a->mul == b->mul &&
+           a->scale == b->scale && a->dec == b->dec;
+}
+
+// Only files this tool wrote are extended, anything else is rewritten
+static int is_appendable(const ldData* old) {
+    const ldHead* head = old->head;
+    return head->meta_ptr == HEADER_PTR && head->device_serial == DEVICE_SERIAL &&
+           head->pro_logging == PRO_LOGGING && old->chann_count > 0;
+}
+
+// Number of leading file channels that are the log's channels under the same name
+static size_t matching_channels(const ldData* old, DataLog* data_log) {
+    size_t count = old->chann_count < data_log->channel_count ? old->chann_count : data_log->channel_count;
+    for (size_t i = 0; i < count; i++) {
+        // the name as it reads back from the record, cut to the field and trimmed
+        char name[sizeof(old->channs[i]->name)];
+        decode_string(data_log->channels[i]->name, sizeof(name) - 1, name, sizeof(name));
+        if (strcmp(name, old->channs[i]->name) != 0) return i;
+    }
+    return count;
+}
+
+// Creates the channel records and encodes every sample. A channel already in the file
+// keeps its encoding while that still holds its values, so the samples on disk stay valid
+static int add_channels(MotecLog* log, DataLog* data_log, const ldData* old, size_t matched) {
+    for (size_t i = 0; i < data_log->channel_count; i++) {
+        Channel* channel = data_log->channels[i];
+        LdEncoding encoding;
+        if (i < matched) {
+            const ldChan* chan = old->channs[i];
+            encoding.dtype = chan->dtype;
+            encoding.shift = chan->shift;
+            encoding.mul = chan->mul;
+            encoding.scale = chan->scale;
+            encoding.dec = chan->dec;
+        }
+        if (i >= matched ||
+            !ld_encoding_holds(channel->values, channel->message_count, channel->decimals, &encoding)) {
+            ld_choose_encoding(channel->values, channel->message_count, channel->decimals, &encoding);
+        }
+        if (motec_log_add_channel_as(log, channel, &encoding) != 0) return -1;
+    }
+    return 0;
+}
+
+// Offset of the first byte where new and old differ, rounded down to a whole sample
+static uint64_t common_prefix(const uint8_t* new_data, const uint8_t* old_data, uint64_t len, size_t sample) {
+    uint64_t offset = 0;
+    while (offset < len) {
+        uint64_t n = len - offset < COMPARE_BLOCK ? len - offset : COMPARE_BLOCK;
+        if (memcmp(new_data + offset, old_data + offset, n) != 0) {
+            while (new_data[offset] == old_data[offset]) offset++;
+            break;
+        }
+        offset += n;
+    }
+    return offset - offset % sample;
+}
+
+// Bytes at the start of chan's region that prev's region already holds. When the log has
+// only grown, the old samples that can change are the ones resampling held at the
+// channel's last value after its last row, a trailing run of identical samples that new
+// rows interpolate away from. Only that run is read back, at most COMPARE_TAIL samples of
+// it, and the samples before it are trusted. Anything that doesn't look like growth (fewer
+// samples, a change just before the run, changes reaching the start of the window) is
+// compared in full
+static uint64_t unchanged_prefix(const ldChan* chan, const ldChan* prev) {
+    size_t sample = ld_sample_size(chan->dtype);
+    const uint8_t* new_data = chan->data;
+    const uint8_t* old_data = prev->data;
+    uint64_t count = prev->data_len;
+    if (chan->data_len < count) return common_prefix(new_data, old_data, region_size(chan), sample);
+    if (count == 0) return 0;
+
+    const uint8_t* held = old_data + (count - 1) * sample;
+    uint64_t first_diff = count;
+    uint64_t stop = count > COMPARE_TAIL ? count - COMPARE_TAIL : 0;
+    for (uint64_t k = count; k-- > stop;) {
+        const uint8_t* old_sample = old_data + k * sample;
+        int same = memcmp(new_data + k * sample, old_sample, sample) == 0;
+        if (memcmp(old_sample, held, sample) != 0) {
+            // the last sample before the held run belongs to rows that were already there
+            if (!same) return common_prefix(new_data, old_data, region_size(prev), sample);
+            return first_diff * sample;
+        }
+        if (!same) first_diff = k;
+    }
+    // interpolation moves the held run monotonically from the held value, if the start of
+    // the window still holds it so does everything before
+    if (stop > 0 && first_diff == stop) return common_prefix(new_data, old_data, region_size(prev), sample);
+    return first_diff * sample;
+}
+
+static int compare_offsets(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Index of the first start after offset (or at it, with inclusive)
+static size_t find_start(const uint64_t* starts, size_t count, uint64_t offset, int inclusive) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (starts[mid] < offset || (!inclusive && starts[mid] == offset)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Bytes from offset to the start of the next record or data region (or the end of the
+// file), how far a data region starting there can grow without moving. owned is how many
+// of the starts at offset are the region itself, none for an empty one
+static uint64_t room_at(const uint64_t* starts, size_t count, uint64_t offset, size_t owned,
+                        uint64_t file_size) {
+    size_t first = find_start(starts, count, offset, 1);
+    size_t next = find_start(starts, count, offset, 0);
+    if (next - first > owned) return 0; // something else starts right there
+    uint64_t limit = next < count ? starts[next] : file_size;
+    if (limit > file_size) limit = file_size;
+    return limit > offset ? limit - offset : 0;
+}
+
+// Places the log's channels in the existing file. Records of channels already in the
+// file stay put, a data region is rewritten from its first changed sample in place
+// while it has room and moved to the end of the file when it doesn't. New channels go
+// at the end. Returns the new file size, 0 = the layout can't be reused
+static uint64_t place_appended(MotecLog* log, const ldData* old, AppendSlot* slots) {
+    size_t old_count = old->chann_count;
+    // where every record and non-empty data region of the file begins
+    uint64_t* starts = malloc(sizeof(uint64_t) * old_count * 2);
+    if (!starts) return 0;
+
+    size_t start_count = 0;
+    for (size_t i = 0; i < old_count; i++) {
+        const ldChan* chan = old->channs[i];
+        starts[start_count++] = chan->meta_ptr;
+        if (chan->data_len > 0) starts[start_count++] = chan->data_ptr;
+    }
+    qsort(starts, start_count, sizeof(uint64_t), compare_offsets);
+
+    uint64_t file_size = old->file.size;
+    uint64_t end = file_size;
+    for (size_t i = 0; i < log->channel_count; i++) {
+        ldChan* chan = log->ld_channels[i];
+        slots[i].write_from = 0;
+
+        if (i >= old_count) {
+            chan->meta_ptr = (uint32_t)end;
+            end += LD_CHAN_META_SIZE;
+            chan->data_ptr = (uint32_t)end;
+            end += region_capacity(chan);
+            continue;
+        }
+
+        const ldChan* prev = old->channs[i];
+        if ((prev->data_len > 0 && !prev->data) || prev->meta_ptr < HEADER_PTR || prev->data_ptr < HEADER_PTR) {
+            free(starts);
+            return 0; // runs past the end of the file or into the header
+        }
+        chan->meta_ptr = prev->meta_ptr;
+
+        uint64_t room = room_at(starts, start_count, prev->data_ptr, prev->data_len > 0, file_size);
+        if (region_size(chan) > room) {
+            chan->data_ptr = (uint32_t)end;
+            end += region_capacity(chan);
+            continue;
+        }
+        chan->data_ptr = prev->data_ptr;
+        if (same_encoding(chan, prev)) slots[i].write_from = unchanged_prefix(chan, prev);
+    }
+
+    free(starts);
+    return end > UINT32_MAX ? 0 : end;
+}
+
+// Lays the channels out from scratch like motec_log_plan_layout, but with every data
+// region followed by room to grow. Returns the file size, 0 = too big for the format
+static uint64_t place_fresh(MotecLog* log, AppendSlot* slots) {
+    uint64_t end = HEADER_PTR + (uint64_t)log->channel_count * LD_CHAN_META_SIZE;
+    log->ld_header->data_ptr = (uint32_t)end;
+    for (size_t i = 0; i < log->channel_count; i++) {
+        ldChan* chan = log->ld_channels[i];
+        chan->meta_ptr = (uint32_t)(HEADER_PTR + i * LD_CHAN_META_SIZE);
+        chan->data_ptr = (uint32_t)end;
+        slots[i].write_from = 0;
+        end += region_capacity(chan);
+    }
+    return end > UINT32_MAX ? 0 : end;
+}
+
+// Bytes the log takes when laid out from scratch
+static uint64_t fresh_size(const MotecLog* log) {
+    uint64_t size = HEADER_PTR + (uint64_t)log->channel_count * LD_CHAN_META_SIZE;
+    for (size_t i = 0; i < log->channel_count; i++) size += region_capacity(log->ld_channels[i]);
+    return size;
+}
+
+static int write_at(int fd, const void* buffer, size_t len, uint64_t offset) {
+    const char* p = buffer;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+// Writes the changed samples, then every channel record, then the header, so the file
+// only points at new data once it is there. 0 = good, -1 = bad
+static int write_appended(MotecLog* log, const AppendSlot* slots, int fd) {
+    size_t count = log->channel_count;
+    for (size_t i = 0; i < count; i++) {
+        ldChan* chan = log->ld_channels[i];
+        uint64_t size = region_size(chan);
+        if (size <= slots[i].write_from) continue;
+        size_t len = (size_t)(size - slots[i].write_from);
+        if (write_at(fd, (const uint8_t*)chan->data + slots[i].write_from, len,
+                     chan->data_ptr + slots[i].write_from) != 0) {
+            return -1;
+        }
+        STATS_ADD(STAT_BYTES_WRITTEN, len);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ldChan* chan = log->ld_channels[i];
+        chan->prev_meta_ptr = i > 0 ? log->ld_channels[i - 1]->meta_ptr : 0;
+        chan->next_meta_ptr = i + 1 < count ? log->ld_channels[i + 1]->meta_ptr : 0;
+    }
+
+    // records that sit back to back go out in one write
+    uint8_t* records = malloc(count * LD_CHAN_META_SIZE);
+    if (!records) return -1;
+    int result = 0;
+    for (size_t first = 0; first < count && result == 0;) {
+        size_t last = first;
+        write_ld_channel(log->ld_channels[first], records, (int)first);
+        while (last + 1 < count &&
+               log->ld_channels[last + 1]->meta_ptr == log->ld_channels[last]->meta_ptr + LD_CHAN_META_SIZE) {
+            last++;
+            write_ld_channel(log->ld_channels[last], records + (last - first) * LD_CHAN_META_SIZE, (int)last);
+        }
+        size_t len = (last - first + 1) * LD_CHAN_META_SIZE;
+        result = write_at(fd, records, len, log->ld_channels[first]->meta_ptr);
+        STATS_ADD(STAT_BYTES_WRITTEN, len);
+        first = last + 1;
+    }
+    free(records);
+    if (result != 0) return -1;
+
+    size_t extent = ld_header_extent(log->ld_header);
+    uint8_t* header = calloc(1, extent);
+    if (!header) return -1;
+    write_ld_header(log->ld_header, header, (uint32_t)count);
+    result = write_at(fd, header, extent, 0);
+    STATS_ADD(STAT_BYTES_WRITTEN, extent);
+    free(header);
+    return result;
+}
+
+// Writes data_log to filename, extending the .ld already there when it was written by
+// this tool from an earlier part of the same log. Only samples that differ from what the
+// file holds are written, usually just the new ones, into room left after every data
+// region. A region that outgrows its room moves to the end of the file. The file is
+// rewritten from scratch when it doesn't match the log (other channels, not ours) or
+// moved regions have grown it past half again its compact size. data_log must only have
+// grown since the file was written, see unchanged_prefix. log must have no channels yet,
+// they are added from data_log. 0 = good, -1 = bad
+int motec_log_append(MotecLog* log, DataLog* data_log, const char* filename) {
+    if (!log || !log->ld_header || !data_log || !filename) return -1;
+    if (log->channel_count != 0 || data_log->channel_count == 0) return -1;
+
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+
+    ldData* old = st.st_size > 0 ? read_ldfile(filename) : NULL;
+    // only the records and the end of every region are read, readahead would pull in the rest
+    if (old) mapped_file_advise(&old->file, MAPPED_ACCESS_RANDOM);
+    if (old && !is_appendable(old)) {
+        free_lddata(old);
+        old = NULL;
+    }
+
+    size_t matched = old ? matching_channels(old, data_log) : 0;
+    if (old && matched < old->chann_count) {
+        free_lddata(old);
+        old = NULL;
+        matched = 0;
+    }
+
+    AppendSlot* slots = calloc(data_log->channel_count, sizeof(AppendSlot));
+    if (!slots || add_channels(log, data_log, old, matched) != 0) {
+        free(slots);
+        free_lddata(old);
+        close(fd);
+        return -1;
+    }
+
+    uint64_t end = 0;
+    if (old) {
+        end = place_appended(log, old, slots);
+        uint64_t compact = fresh_size(log);
+        if (end > compact + compact / 2) end = 0;
+        if (end) {
+            // the session still started when the file was first written
+            log->ld_header->data_ptr = old->head->data_ptr;
+            log->ld_header->datetime = old->head->datetime;
+        }
+        free_lddata(old);
+    }
+
+    int result = 0;
+    uint64_t size = (uint64_t)st.st_size;
+    if (!end) {
+        end = place_fresh(log, slots);
+        // nothing of the old file survives, start from zeros
+        result = end && ftruncate(fd, 0) == 0 ? 0 : -1;
+        size = 0;
+    }
+    log->ld_header->meta_ptr = log->ld_channels[0]->meta_ptr;
+
+    if (result == 0 && end > size) result = ftruncate(fd, (off_t)end) == 0 ? 0 : -1;
+    if (result == 0) result = write_appended(log, slots, fd);
+
+    free(slots);
+    if (close(fd) != 0) result = -1;
+    return result;
+}
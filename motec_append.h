@@ -0,0 +1,10 @@
+#ifndef MOTEC_APPEND_H
+#define MOTEC_APPEND_H
+
+#include "motec_log.h"
+
+#define APPEND_MIN_SLACK 1024 // samples reserved past the end of every data region
+
+int motec_log_append(MotecLog* log, DataLog* data_log, const char* filename);
+
+#endif
@@ -1,7 +1,16 @@
 #include "motec_log.h"
+#include "ld_codec.h"
+#include "parallel.h"
+#include "stats.h"
 #include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define INITIAL_CHANNEL_CAPACITY 1000
+#define ARENA_BLOCK_SIZE (64 << 10)
 
 MotecLog* motec_log_create(void) {
     MotecLog* log = (MotecLog*)malloc(sizeof(MotecLog));
@@ -11,7 +20,8 @@ MotecLog* motec_log_create(void) {
     
     log->channel_capacity = INITIAL_CHANNEL_CAPACITY;
     log->ld_channels = (ldChan**)malloc(sizeof(ldChan*) * log->channel_capacity);
-    if (!log->ld_channels) {
+    if (!log->ld_channels || arena_init(&log->arena, ARENA_BLOCK_SIZE) != 0) {
+        free(log->ld_channels);
         free(log);
         return NULL;
     }
@@ -25,17 +35,9 @@ MotecLog* motec_log_create(void) {
 void motec_log_free(MotecLog* log) {
     if (!log) return;
     
-    if (log->ld_channels) {
-        for (size_t i = 0; i < log->channel_count; i++) {
-            if (log->ld_channels[i]) {
-                if (log->ld_channels[i]->data) {
-                    free(log->ld_channels[i]->data);
-                }
-                free(log->ld_channels[i]);
-            }
-        }
-        free(log->ld_channels);
-    }
+    // the channel records and their data all live in the arena
+    arena_destroy(&log->arena);
+    free(log->ld_channels);
     
     if (log->ld_header) {
         if (log->ld_header->event) {
@@ -57,7 +59,7 @@ int motec_log_initialize(MotecLog* log) {
     if (!log) return -1;
     
     // Create vehicle
-    ldVehicle* vehicle = (ldVehicle*)malloc(sizeof(ldVehicle));
+    ldVehicle* vehicle = (ldVehicle*)calloc(1, sizeof(ldVehicle));
     if (!vehicle) return -1;
     
     strncpy(vehicle->id, log->vehicle_id, sizeof(vehicle->id)-1);
@@ -66,7 +68,7 @@ int motec_log_initialize(MotecLog* log) {
     strncpy(vehicle->comment, log->vehicle_comment, sizeof(vehicle->comment)-1);
     
     // Create venue
-    ldVenue* venue = (ldVenue*)malloc(sizeof(ldVenue));
+    ldVenue* venue = (ldVenue*)calloc(1, sizeof(ldVenue));
     if (!venue) {
         free(vehicle);
         return -1;
@@ -77,7 +79,7 @@ int motec_log_initialize(MotecLog* log) {
     venue->vehicle = vehicle;
     
     // Create event
-    ldEvent* event = (ldEvent*)malloc(sizeof(ldEvent));
+    ldEvent* event = (ldEvent*)calloc(1, sizeof(ldEvent));
     if (!event) {
         free(venue);
         free(vehicle);
@@ -91,7 +93,7 @@ int motec_log_initialize(MotecLog* log) {
     event->venue = venue;
     
     // Create header
-    log->ld_header = (ldHead*)malloc(sizeof(ldHead));
+    log->ld_header = (ldHead*)calloc(1, sizeof(ldHead));
     if (!log->ld_header) {
         free(event);
         free(venue);
@@ -108,174 +110,246 @@ int motec_log_initialize(MotecLog* log) {
     strncpy(log->ld_header->vehicleid, log->vehicle_id, sizeof(log->ld_header->vehicleid)-1);
     strncpy(log->ld_header->venue, log->venue_name, sizeof(log->ld_header->venue)-1);
     
-    // Convert time_t to struct tm
-    struct tm* timeinfo = localtime(&log->datetime);
-    if (timeinfo) {
-        log->ld_header->datetime = *timeinfo;
+    // Convert time_t to struct tm, localtime_r as batch jobs initialize logs concurrently
+    struct tm timeinfo;
+    if (localtime_r(&log->datetime, &timeinfo)) {
+        log->ld_header->datetime = timeinfo;
     }
     
     strncpy(log->ld_header->short_comment, log->short_comment, sizeof(log->ld_header->short_comment)-1);
     
+    log->ld_header->device_serial = DEVICE_SERIAL;
+    strncpy(log->ld_header->device_type, DEVICE_TYPE, sizeof(log->ld_header->device_type)-1);
+    log->ld_header->device_version = DEVICE_VERSION;
+    log->ld_header->pro_logging = PRO_LOGGING;
+    
     return 0;
 }
 
-int motec_log_add_channel(MotecLog* log, Channel* channel) {
-    if (!log || !channel) return -1;
+// Makes room for count more channel records
+static int reserve_channels(MotecLog* log, size_t count) {
+    if (log->channel_count + count <= log->channel_capacity) return 0;
     
-    if (log->channel_count >= log->channel_capacity) {
-        size_t new_capacity = log->channel_capacity * 2;
-        ldChan** new_channels = (ldChan**)realloc(log->ld_channels, 
-            sizeof(ldChan*) * new_capacity);
-        if (!new_channels) return -1;
-        
-        log->ld_channels = new_channels;
-        log->channel_capacity = new_capacity;
-    }
+    size_t new_capacity = log->channel_capacity ? log->channel_capacity : INITIAL_CHANNEL_CAPACITY;
+    while (new_capacity < log->channel_count + count) new_capacity *= 2;
     
-    log->ld_header->data_ptr += sizeof(ldChan);
+    ldChan** new_channels = (ldChan**)realloc(log->ld_channels, sizeof(ldChan*) * new_capacity);
+    if (!new_channels) return -1;
     
-    for (size_t i = 0; i < log->channel_count; i++) {
-        log->ld_channels[i]->data_ptr += sizeof(ldChan);
-    }
-    
-    int meta_ptr, prev_meta_ptr, data_ptr;
-    if (log->channel_count > 0) {
-        meta_ptr = log->ld_channels[log->channel_count-1]->next_meta_ptr;
-        prev_meta_ptr = log->ld_channels[log->channel_count-1]->meta_ptr;
-        data_ptr = log->ld_channels[log->channel_count-1]->data_ptr + 
-            log->ld_channels[log->channel_count-1]->data_len * sizeof(float);
-    } else {
-        meta_ptr = HEADER_PTR;
-        prev_meta_ptr = 0;
-        data_ptr = log->ld_header->data_ptr;
-    }
-    
-    ldChan* ld_channel = (ldChan*)malloc(sizeof(ldChan));
-    if (!ld_channel) return -1;
-    
-    ld_channel->meta_ptr = meta_ptr;
-    ld_channel->prev_meta_ptr = prev_meta_ptr;
-    ld_channel->next_meta_ptr = meta_ptr + sizeof(ldChan);
-    ld_channel->data_ptr = data_ptr;
-    ld_channel->data_len = channel->message_count;
+    log->ld_channels = new_channels;
+    log->channel_capacity = new_capacity;
+    return 0;
+}
+
+// Appends a float32 channel record for data_len samples. Its file offsets are filled in
+// by motec_log_plan_layout, and its data is left NULL for the caller to fill (or to
+// stream straight to disk)
+ldChan* motec_log_new_channel(MotecLog* log, const char* name, const char* units,
+                              uint32_t data_len, double frequency) {
+    if (!log || !name || !units) return NULL;
+    if (reserve_channels(log, 1) != 0) return NULL;
+    
+    ldChan* ld_channel = (ldChan*)arena_calloc(&log->arena, sizeof(ldChan));
+    if (!ld_channel) return NULL;
+    
+    ld_channel->data_len = data_len;
     ld_channel->dtype = DTYPE_FLOAT32;
-    ld_channel->freq = (int)channel_avg_frequency(channel);
+    ld_channel->freq = (uint16_t)lround(frequency);
     ld_channel->shift = 0;
     ld_channel->mul = 1;
     ld_channel->scale = 1;
     ld_channel->dec = 0;
-    strncpy(ld_channel->name, channel->name, sizeof(ld_channel->name)-1);
-    strncpy(ld_channel->unit, channel->units, sizeof(ld_channel->unit)-1);
+    strncpy(ld_channel->name, name, sizeof(ld_channel->name)-1);
+    strncpy(ld_channel->unit, units, sizeof(ld_channel->unit)-1);
     
-    ld_channel->data = malloc(channel->message_count * sizeof(float));
-    if (!ld_channel->data) {
-        free(ld_channel);
-        return -1;
+    log->ld_channels[log->channel_count++] = ld_channel;
+    return ld_channel;
+}
+
+// Places every channel in one pass: the metadata records are chained back to back
+// from HEADER_PTR, and the data regions follow them in the same order.
+// 0 = good, -1 = the file would not fit the format's 32 bit offsets
+int motec_log_plan_layout(MotecLog* log) {
+    if (!log || !log->ld_header) return -1;
+    
+    uint64_t meta_ptr = HEADER_PTR;
+    uint64_t data_ptr = HEADER_PTR + (uint64_t)log->channel_count * LD_CHAN_META_SIZE;
+    
+    log->ld_header->meta_ptr = HEADER_PTR;
+    log->ld_header->data_ptr = (uint32_t)data_ptr;
+    
+    for (size_t i = 0; i < log->channel_count; i++) {
+        ldChan* chan = log->ld_channels[i];
+        int last = i + 1 == log->channel_count;
+        
+        chan->meta_ptr = (uint32_t)meta_ptr;
+        chan->prev_meta_ptr = i > 0 ? (uint32_t)(meta_ptr - LD_CHAN_META_SIZE) : 0;
+        chan->next_meta_ptr = last ? 0 : (uint32_t)(meta_ptr + LD_CHAN_META_SIZE);
+        chan->data_ptr = (uint32_t)data_ptr;
+        
+        meta_ptr += LD_CHAN_META_SIZE;
+        data_ptr += (uint64_t)chan->data_len * ld_sample_size(chan->dtype);
     }
     
-    for (size_t i = 0; i < channel->message_count; i++) {
-        ((float*)ld_channel->data)[i] = (float)channel->messages[i].value;
+    return data_ptr > UINT32_MAX ? -1 : 0;
+}
+
+int motec_log_add_channel(MotecLog* log, Channel* channel) {
+    if (!log || !channel) return -1;
+    
+    // stored in the smallest dtype that keeps the channel's display precision
+    LdEncoding encoding;
+    ld_choose_encoding(channel->values, channel->message_count, channel->decimals, &encoding);
+    return motec_log_add_channel_as(log, channel, &encoding);
+}
+
+// Adds a channel with its samples encoded as given, 0 = good, -1 = bad
+int motec_log_add_channel_as(MotecLog* log, Channel* channel, const LdEncoding* encoding) {
+    if (!log || !channel || !encoding) return -1;
+    
+    size_t size = (channel->message_count ? channel->message_count : 1) * ld_sample_size(encoding->dtype);
+    void* data = arena_alloc(&log->arena, size);
+    if (!data) return -1;
+    STATS_ADD(STAT_ALLOCATIONS, 1);
+    ld_encode_samples_into(channel->values, channel->message_count, encoding, data);
+    
+    double frequency = channel->frequency > 0.0 ? channel->frequency : channel_avg_frequency(channel);
+    ldChan* ld_channel = motec_log_new_channel(log, channel->name, channel->units,
+                                               (uint32_t)channel->message_count, frequency);
+    if (!ld_channel) {
+        arena_free(&log->arena, data, size);
+        return -1;
     }
     
-    log->ld_channels[log->channel_count++] = ld_channel;
+    ld_channel->dtype = encoding->dtype;
+    ld_channel->shift = encoding->shift;
+    ld_channel->mul = encoding->mul;
+    ld_channel->scale = encoding->scale;
+    ld_channel->dec = encoding->dec;
+    ld_channel->data = data;
     return 0;
 }
 
 int motec_log_add_all_channels(MotecLog* log, DataLog* data_log) {
     if (!log || !data_log) return -1;
+    if (reserve_channels(log, data_log->channel_count) != 0) return -1;
     
     for (size_t i = 0; i < data_log->channel_count; i++) {
         if (motec_log_add_channel(log, data_log->channels[i]) != 0) {
             return -1;
         }
     }
-    return 0;
+    return motec_log_plan_layout(log);
 }
 
-void write_ld_header(ldHead* header, FILE* f, int channel_count) {
-    fwrite(&header->meta_ptr, sizeof(uint32_t), 1, f);
-    fwrite(&header->data_ptr, sizeof(uint32_t), 1, f);
-    fwrite(&header->event_ptr, sizeof(uint32_t), 1, f);
-    
-    fwrite(header->driver, sizeof(char), 64, f);
-    fwrite(header->vehicleid, sizeof(char), 64, f);
-    fwrite(header->venue, sizeof(char), 64, f);
-    
-    fwrite(&header->datetime, sizeof(struct tm), 1, f);
-    fwrite(header->short_comment, sizeof(char), 64, f);
-    
-    if (header->event) {
-        fseek(f, header->event_ptr, SEEK_SET);
-        fwrite(header->event->name, sizeof(char), 64, f);
-        fwrite(header->event->session, sizeof(char), 64, f);
-        fwrite(header->event->comment, sizeof(char), 1024, f);
-        fwrite(&header->event->venue_ptr, sizeof(uint16_t), 1, f);
-        
-        if (header->event->venue) {
-            fseek(f, header->event->venue_ptr, SEEK_SET);
-            fwrite(header->event->venue->name, sizeof(char), 64, f);
-            fwrite(&header->event->venue->vehicle_ptr, sizeof(uint16_t), 1, f);
-            
-            if (header->event->venue->vehicle) {
-                fseek(f, header->event->venue->vehicle_ptr, SEEK_SET);
-                fwrite(header->event->venue->vehicle->id, sizeof(char), 64, f);
-                fwrite(&header->event->venue->vehicle->weight, sizeof(uint32_t), 1, f);
-                fwrite(header->event->venue->vehicle->type, sizeof(char), 32, f);
-                fwrite(header->event->venue->vehicle->comment, sizeof(char), 32, f);
-            }
-        }
+// Lays out the file and serializes everything before the first data region: the header
+// and every channel record. Returns a buffer of log->ld_header->data_ptr bytes, NULL = bad
+static uint8_t* serialize_metadata(MotecLog* log) {
+    if (motec_log_plan_layout(log) != 0) return NULL;
+    
+    uint8_t* buffer = calloc(1, log->ld_header->data_ptr);
+    if (!buffer) return NULL;
+    
+    write_ld_header(log->ld_header, buffer, (uint32_t)log->channel_count);
+    for (size_t i = 0; i < log->channel_count; i++) {
+        write_ld_channel(log->ld_channels[i], buffer + log->ld_channels[i]->meta_ptr, i);
     }
+    return buffer;
 }
 
-void write_ld_channel(ldChan* channel, FILE* f, int channel_index) {
-    uint16_t dtype_a = (channel->dtype == DTYPE_FLOAT32 || channel->dtype == DTYPE_FLOAT16) ? 0x07 : 0x00;
-    uint16_t dtype = (channel->dtype == DTYPE_FLOAT16 || channel->dtype == DTYPE_INT16) ? 2 : 4;
-    uint16_t magic = 0x2ee1 + channel_index;
-
-    fwrite(&channel->prev_meta_ptr, sizeof(uint32_t), 1, f);
-    fwrite(&channel->next_meta_ptr, sizeof(uint32_t), 1, f);
-    fwrite(&channel->data_ptr, sizeof(uint32_t), 1, f);
-    fwrite(&channel->data_len, sizeof(uint32_t), 1, f);
-
-    fwrite(&magic, sizeof(uint16_t), 1, f);
-    fwrite(&dtype_a, sizeof(uint16_t), 1, f);
-    fwrite(&dtype, sizeof(uint16_t), 1, f);
-    fwrite(&channel->freq, sizeof(int16_t), 1, f);
-    fwrite(&channel->shift, sizeof(int16_t), 1, f);
-    fwrite(&channel->mul, sizeof(int16_t), 1, f);
-    fwrite(&channel->scale, sizeof(int16_t), 1, f);
-    fwrite(&channel->dec, sizeof(int16_t), 1, f);
-
-    fwrite(channel->name, sizeof(char), 32, f);
-    fwrite(channel->short_name, sizeof(char), 8, f);
-    fwrite(channel->unit, sizeof(char), 12, f);
+// Lays out the file and writes the header and every channel record, but no sample data.
+// 0 = good, -1 = bad
+int motec_log_write_metadata(MotecLog* log, FILE* f) {
+    uint8_t* buffer = serialize_metadata(log);
+    if (!buffer) return -1;
+    
+    size_t size = log->ld_header->data_ptr;
+    int result = fwrite(buffer, 1, size, f) == size ? 0 : -1;
+    STATS_ADD(STAT_BYTES_WRITTEN, size);
+    free(buffer);
+    return result;
 }
 
+// Writes the log with buffered stdio. The data regions follow the metadata back to
+// back, so the whole file goes out in order without seeking. 0 = good, -1 = bad
 int motec_log_write(MotecLog* log, const char* filename) {
     if (!log || !filename) return -1;
     
     FILE* f = fopen(filename, "wb");
     if (!f) return -1;
     
+    int result = motec_log_write_metadata(log, f);
+    
+    for (size_t i = 0; i < log->channel_count && result == 0; i++) {
+        ldChan* chan = log->ld_channels[i];
+        if (fwrite(chan->data, ld_sample_size(chan->dtype), chan->data_len, f) != chan->data_len) result = -1;
+        STATS_ADD(STAT_BYTES_WRITTEN, (size_t)chan->data_len * ld_sample_size(chan->dtype));
+    }
+    
+    if (fclose(f) != 0) result = -1;
+    return result;
+}
+
+typedef struct MappedWriteJob {
+    MotecLog* log;
+    uint8_t* map;
+} MappedWriteJob;
+
+// Fills one channel's metadata record and data region, which no other task touches
+static void write_mapped_channel_task(void* context, size_t index) {
+    MappedWriteJob* job = (MappedWriteJob*)context;
+    ldChan* chan = job->log->ld_channels[index];
+    
+    write_ld_channel(chan, job->map + chan->meta_ptr, (int)index);
+    if (chan->data_len > 0) {
+        memcpy(job->map + chan->data_ptr, chan->data, (size_t)chan->data_len * ld_sample_size(chan->dtype));
+    }
+}
+
+// Writes the log by sizing the output up front, mapping it, and filling every channel's
+// disjoint regions from thread_count workers. Fails (-1) on outputs that can't be mapped,
+// callers can fall back to motec_log_write. 0 = good, -1 = bad
+int motec_log_write_mapped(MotecLog* log, const char* filename, int thread_count) {
+    if (!log || !filename) return -1;
+    if (motec_log_plan_layout(log) != 0) return -1;
+    
+    size_t size = log->ld_header->data_ptr;
     if (log->channel_count > 0) {
-        log->ld_channels[log->channel_count-1]->next_meta_ptr = 0;
-        
-        write_ld_header(log->ld_header, f, log->channel_count);
-        
-        for (size_t i = 0; i < log->channel_count; i++) {
-            ldChan* chan = log->ld_channels[i];
-            fseek(f, chan->meta_ptr, SEEK_SET);
-            write_ld_channel(chan, f, i);
-            
-            fseek(f, chan->data_ptr, SEEK_SET);
-            fwrite(chan->data, sizeof(float), chan->data_len, f);
-        }
-    } else {
-        write_ld_header(log->ld_header, f, 0);
+        ldChan* last = log->ld_channels[log->channel_count-1];
+        size = (size_t)last->data_ptr + (size_t)last->data_len * ld_sample_size(last->dtype);
     }
     
-    fclose(f);
-    return 0;
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    
+    // the blocks are allocated up front: a sparse file that runs out of disk while the
+    // mapping is written back raises SIGBUS instead of returning an error, so a full disk
+    // fails here and the caller falls back to motec_log_write
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || ftruncate(fd, (off_t)size) != 0 ||
+        posix_fallocate(fd, 0, (off_t)size) != 0) {
+        close(fd);
+        return -1;
+    }
+    
+    uint8_t* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    
+    // the file is fresh from ftruncate, so everything not written below reads as zero
+    write_ld_header(log->ld_header, map, (uint32_t)log->channel_count);
+    
+    MappedWriteJob job = {log, map};
+    parallel_for(log->channel_count, thread_count, write_mapped_channel_task, &job);
+    
+    // start writeback for the whole file at once, like fclose this doesn't wait for the disk
+    int result = msync(map, size, MS_ASYNC) == 0 ? 0 : -1;
+    munmap(map, size);
+    if (close(fd) != 0) result = -1;
+    STATS_ADD(STAT_BYTES_WRITTEN, size);
+    return result;
 }
 
 void motec_log_set_metadata(MotecLog* log,
@@ -3,6 +3,8 @@
 
 #include "ldparser.h"
 #include "data_log.h"
+#include "arena.h"
+#include "ld_codec.h"
 #include <time.h>
 
 // Constants from original file
@@ -11,11 +13,11 @@
 #define EVENT_PTR 8180
 #define HEADER_PTR 11336
 
-// Data type constants
-#define DTYPE_FLOAT32 1
-#define DTYPE_FLOAT16 2
-#define DTYPE_INT32 3
-#define DTYPE_INT16 4
+// Logger device written into the header, the values MoTeC's own ADL files carry
+#define DEVICE_SERIAL 0x1f44
+#define DEVICE_TYPE "ADL"
+#define DEVICE_VERSION 420
+#define PRO_LOGGING 0xc81a4
 
 typedef struct {
     char driver[64];
@@ -34,16 +36,21 @@ typedef struct {
     ldChan** ld_channels;
     size_t channel_count;
     size_t channel_capacity;
+    Arena arena; // every ldChan record and its encoded samples
 } MotecLog;
 
 MotecLog* motec_log_create(void);
 void motec_log_free(MotecLog* log);
 int motec_log_initialize(MotecLog* log);
+ldChan* motec_log_new_channel(MotecLog* log, const char* name, const char* units,
+                              uint32_t data_len, double frequency);
 int motec_log_add_channel(MotecLog* log, Channel* channel);
+int motec_log_add_channel_as(MotecLog* log, Channel* channel, const LdEncoding* encoding);
 int motec_log_add_all_channels(MotecLog* log, DataLog* data_log);
+int motec_log_plan_layout(MotecLog* log);
 int motec_log_write(MotecLog* log, const char* filename);
-void write_ld_header(ldHead* header, FILE* f, int channel_count);
-void write_ld_channel(ldChan* channel, FILE* f, int channel_index);
+int motec_log_write_mapped(MotecLog* log, const char* filename, int thread_count);
+int motec_log_write_metadata(MotecLog* log, FILE* f);
 
 void motec_log_set_metadata(MotecLog* log, 
                            const char* driver,
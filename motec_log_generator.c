@@ -1,9 +1,57 @@
+#define _GNU_SOURCE // ppoll
 #include "motec_log_generator.h"
+#include "mapped_file.h"
+#include "dbc_plan.h"
+#include "motec_stream.h"
+#include "motec_append.h"
+#include "parallel.h"
+#include "stats.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <glob.h>
 #include <libgen.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #define DEFAULT_FREQUENCY 20.0
+#define BATCH_MEMORY_FACTOR 3 // a loaded log (values, resampled copy, output) is about 3x its text
+#define DEFAULT_PUBLISH_INTERVAL 2.0
+#define FOLLOW_READ_SIZE (1 << 20) // bytes read from the followed log at once
+#define FOLLOW_POLL_MS 500 // how often the log is checked when inotify isn't available
+
+// Values for long options that have no short form
+enum {
+    OPT_NO_MMAP = 256,
+    OPT_THREADS,
+    OPT_INTERPOLATION,
+    OPT_STREAM,
+    OPT_MEMORY_BUDGET,
+    OPT_BATCH,
+    OPT_JOBS,
+    OPT_BATCH_MEMORY,
+    OPT_STATS,
+    OPT_APPEND,
+    OPT_FOLLOW,
+    OPT_PUBLISH_INTERVAL
+};
+
+// State shared by every job of a --batch run, NULL when converting a single log
+typedef struct BatchShared {
+    DbcPlan* dbc_plan; // --dbc, compiled once for every CAN log
+    pthread_mutex_t schema_lock;
+    LogSchema** schemas; // header rows seen so far, logs from the same logger reuse one
+    size_t schema_count;
+    size_t schema_capacity;
+} BatchShared;
 
 static const char* DESCRIPTION = 
     "Generates MoTeC .ld files from external log files generated by: CAN bus dumps, CSV\n"
@@ -29,6 +77,9 @@ int parse_arguments(int argc, char** argv, GeneratorArgs* args) {
     // defaults
     memset(args, 0, sizeof(GeneratorArgs));
     args->frequency = DEFAULT_FREQUENCY;
+    args->threads = 1;
+    args->memory_budget = DEFAULT_MEMORY_BUDGET >> 20;
+    args->publish_interval = DEFAULT_PUBLISH_INTERVAL;
     
     static struct option long_options[] = {
         {"output", required_argument, 0, 'o'},
@@ -44,6 +95,18 @@ int parse_arguments(int argc, char** argv, GeneratorArgs* args) {
         {"event_session", required_argument, 0, 's'},
         {"long_comment", required_argument, 0, 'l'},
         {"short_comment", required_argument, 0, 'h'},
+        {"no_mmap", no_argument, 0, OPT_NO_MMAP},
+        {"threads", required_argument, 0, OPT_THREADS},
+        {"interpolation", required_argument, 0, OPT_INTERPOLATION},
+        {"stream", no_argument, 0, OPT_STREAM},
+        {"memory_budget", required_argument, 0, OPT_MEMORY_BUDGET},
+        {"batch", no_argument, 0, OPT_BATCH},
+        {"jobs", required_argument, 0, OPT_JOBS},
+        {"batch_memory", required_argument, 0, OPT_BATCH_MEMORY},
+        {"stats", optional_argument, 0, OPT_STATS},
+        {"append", no_argument, 0, OPT_APPEND},
+        {"follow", no_argument, 0, OPT_FOLLOW},
+        {"publish_interval", required_argument, 0, OPT_PUBLISH_INTERVAL},
         {0, 0, 0, 0}
     };
 
@@ -64,10 +127,71 @@ int parse_arguments(int argc, char** argv, GeneratorArgs* args) {
             case 's': args->event_session = strdup(optarg); break;
             case 'l': args->long_comment = strdup(optarg); break;
             case 'h': args->short_comment = strdup(optarg); break;
+            case OPT_NO_MMAP: args->no_mmap = 1; break;
+            case OPT_THREADS: args->threads = atoi(optarg); break;
+            case OPT_INTERPOLATION:
+                if (strcmp(optarg, "linear") == 0) {
+                    args->interpolation = RESAMPLE_LINEAR;
+                } else if (strcmp(optarg, "hold") == 0) {
+                    args->interpolation = RESAMPLE_HOLD;
+                } else {
+                    printf("ERROR: Invalid interpolation: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_STREAM: args->stream = 1; break;
+            case OPT_MEMORY_BUDGET: args->memory_budget = atoi(optarg); break;
+            case OPT_BATCH: args->batch = 1; break;
+            case OPT_JOBS: args->jobs = atoi(optarg); break;
+            case OPT_BATCH_MEMORY: args->batch_memory = atoi(optarg); break;
+            case OPT_APPEND: args->append = 1; break;
+            case OPT_FOLLOW: args->follow = 1; break;
+            case OPT_PUBLISH_INTERVAL: args->publish_interval = atof(optarg); break;
+            case OPT_STATS:
+                if (!STATS_ENABLED) {
+                    printf("ERROR: --stats is not available, built with MOTEC_NO_STATS\n");
+                    return -1;
+                }
+                if (!optarg) {
+                    args->stats = STATS_REPORT_TEXT;
+                } else if (strcmp(optarg, "json") == 0) {
+                    args->stats = STATS_REPORT_JSON;
+                } else {
+                    printf("ERROR: Invalid stats format: %s\n", optarg);
+                    return -1;
+                }
+                break;
             default: return -1;
         }
     }
 
+    if (args->frequency < 0) {
+        printf("ERROR: Invalid frequency: %f\n", args->frequency);
+        return -1;
+    }
+    if (args->threads < 0) {
+        printf("ERROR: Invalid thread count: %d\n", args->threads);
+        return -1;
+    }
+    if (args->memory_budget <= 0) {
+        printf("ERROR: Invalid memory budget: %d\n", args->memory_budget);
+        return -1;
+    }
+    if (args->jobs < 0) {
+        printf("ERROR: Invalid job count: %d\n", args->jobs);
+        return -1;
+    }
+    if (args->batch_memory < 0) {
+        printf("ERROR: Invalid batch memory: %d\n", args->batch_memory);
+        return -1;
+    }
+    if (args->publish_interval <= 0) {
+        printf("ERROR: Invalid publish interval: %f\n", args->publish_interval);
+        return -1;
+    }
+    if (args->threads == 0) args->threads = parallel_default_threads();
+    if (args->jobs == 0) args->jobs = parallel_default_threads();
+
     if (optind + 1 >= argc) {
         print_usage();
         return -1;
@@ -91,6 +215,23 @@ int parse_arguments(int argc, char** argv, GeneratorArgs* args) {
         return -1;
     }
 
+    if (args->stream && args->log_type != LOG_TYPE_CSV) {
+        printf("ERROR: --stream is only supported for CSV logs\n");
+        return -1;
+    }
+    if (args->stream && args->append) {
+        printf("ERROR: --append can't be combined with --stream\n");
+        return -1;
+    }
+    if (args->follow && args->log_type == LOG_TYPE_CAN) {
+        printf("ERROR: --follow is only supported for CSV and ACCESSPORT logs\n");
+        return -1;
+    }
+    if (args->follow && (args->stream || args->batch)) {
+        printf("ERROR: --follow can't be combined with --stream or --batch\n");
+        return -1;
+    }
+
     return 0;
 }
 
@@ -114,58 +255,108 @@ char* get_output_filename(const char* input_path, const char* output_path) {
     }
 }
 
-int process_log_file(const GeneratorArgs* args) {
-    printf("Loading log...\n");
-    
-    FILE* f = fopen(args->log_path, "r");
-    if (!f) {
-        printf("ERROR: Cannot open log file: %s\n", args->log_path);
+// Progress messages, errors are always printed
+static void progress(const GeneratorArgs* args, const char* format, ...) {
+    if (args->quiet) return;
+    va_list ap;
+    va_start(ap, format);
+    vprintf(format, ap);
+    va_end(ap);
+}
+
+// Decodes a candump log with the DBC given by --dbc, 0 = good, -1 = bad
+static int load_can_log(const GeneratorArgs* args, DataLog* data_log, const MappedFile* input,
+                        BatchShared* batch) {
+    if (batch && batch->dbc_plan) {
+        return datalog_from_can_buffer(data_log, input->data, input->size, batch->dbc_plan);
+    }
+
+    progress(args, "Loading DBC...\n");
+    DbcPlan* plan = dbc_plan_load(args->dbc_path);
+    if (!plan) {
+        printf("ERROR: Cannot load DBC file: %s\n", args->dbc_path);
         return -1;
     }
 
-    DataLog* data_log = datalog_create(""); 
-    if (!data_log) {
-        fclose(f);
+    int result = datalog_from_can_buffer(data_log, input->data, input->size, plan);
+    dbc_plan_free(plan);
+    return result;
+}
+
+// The batch's schema for a log starting with these header rows, parsed and kept on first sight
+static const LogSchema* batch_schema(BatchShared* batch, LogSchemaFormat format, const char* data, size_t len) {
+    pthread_mutex_lock(&batch->schema_lock);
+    LogSchema* schema = NULL;
+    for (size_t i = 0; i < batch->schema_count && !schema; i++) {
+        LogSchema* cached = batch->schemas[i];
+        // an empty header would match every log
+        if (cached->format == format && cached->header_len > 0 && log_schema_matches(cached, data, len)) {
+            schema = cached;
+        }
+    }
+
+    if (!schema && batch->schema_count >= batch->schema_capacity) {
+        size_t capacity = batch->schema_capacity ? batch->schema_capacity * 2 : 8;
+        LogSchema** schemas = realloc(batch->schemas, capacity * sizeof(LogSchema*));
+        if (schemas) {
+            batch->schemas = schemas;
+            batch->schema_capacity = capacity;
+        }
+    }
+    if (!schema && batch->schema_count < batch->schema_capacity) {
+        schema = log_schema_parse(format, data, len);
+        if (schema) batch->schemas[batch->schema_count++] = schema;
+    }
+    pthread_mutex_unlock(&batch->schema_lock);
+    return schema;
+}
+
+// Parses a CSV or Accessport log, with the batch's shared schema when there is one
+static int load_csv_log(const GeneratorArgs* args, DataLog* data_log, const MappedFile* input,
+                        LogSchemaFormat format, BatchShared* batch) {
+    if (!batch) {
+        if (format == LOG_SCHEMA_ACCESSPORT) {
+            return datalog_from_accessport_buffer(data_log, input->data, input->size, args->threads);
+        }
+        return datalog_from_csv_buffer_threaded(data_log, input->data, input->size, args->threads);
+    }
+
+    const LogSchema* schema = batch_schema(batch, format, input->data, input->size);
+    if (!schema) return -1;
+    return datalog_from_schema_buffer(data_log, schema, input->data, input->size, args->threads);
+}
+
+// Fills data_log from the input log, 0 = good, -1 = bad
+static int load_log(const GeneratorArgs* args, DataLog* data_log, BatchShared* batch) {
+    // logs are parsed in place, straight out of the page cache when the input can be mapped
+    MappedFile input;
+    if (mapped_file_open(&input, args->log_path, !args->no_mmap, MAPPED_ACCESS_SEQUENTIAL) != 0) {
+        printf("ERROR: Cannot open log file: %s\n", args->log_path);
         return -1;
     }
+    STATS_ADD(STAT_BYTES_READ, input.size);
 
-    int result = 0;
+    int result = -1;
     switch (args->log_type) {
         case LOG_TYPE_CAN:
-            if (args->dbc_path) {
-                printf("Loading DBC...\n");
-                result = datalog_from_can_log(data_log, f, args->dbc_path);
-            }
+            result = load_can_log(args, data_log, &input, batch);
             break;
         case LOG_TYPE_CSV:
-            result = datalog_from_csv_log(data_log, f);
+            result = load_csv_log(args, data_log, &input, LOG_SCHEMA_CSV, batch);
             break;
         case LOG_TYPE_ACCESSPORT:
-            result = datalog_from_accessport_log(data_log, f);
+            result = load_csv_log(args, data_log, &input, LOG_SCHEMA_ACCESSPORT, batch);
             break;
     }
 
-    fclose(f);
-
-    if (result != 0 || datalog_channel_count(data_log) == 0) {
-        printf("ERROR: Failed to find any channels in log data\n");
-        // printf("Found %d channels in data_log\n", datalog_channel_count(data_log)); // Debug
-        datalog_free(data_log);
-        return -1;
-    }
-
-    printf("Parsed %.1fs log with %d channels:\n",
-       datalog_duration(data_log),  
-       datalog_channel_count(data_log));
-
-    data_log_print_channels(data_log);
+    mapped_file_close(&input);
+    return result;
+}
 
-    printf("Converting to MoTeC log...\n");
+// Creates the MoTeC log with the metadata given on the command line
+static MotecLog* create_motec_log(const GeneratorArgs* args) {
     MotecLog* motec_log = motec_log_create();
-    if (!motec_log) {
-        datalog_free(data_log);
-        return -1;
-    }
+    if (!motec_log) return NULL;
 
     motec_log_set_metadata(motec_log, 
                           args->driver,
@@ -180,38 +371,711 @@ int process_log_file(const GeneratorArgs* args) {
                           args->short_comment);
 
     motec_log_initialize(motec_log);
-    motec_log_add_all_channels(motec_log, data_log);
+    return motec_log;
+}
 
+// Works out the output filename and makes sure its directory exists
+static char* prepare_output(const GeneratorArgs* args) {
     char* output_filename = get_output_filename(args->log_path, args->output_path);
-    char* output_dir = dirname(strdup(output_filename));
-    
-    struct stat st = {0};
-    if (stat(output_dir, &st) == -1) {
-        printf("Directory '%s' does not exist, will create it\n", output_dir);
-        mkdir(output_dir, 0700);
+    if (!output_filename) return NULL;
+
+    // dirname may return static storage or point into its argument, so only the copy is freed
+    char* output_copy = strdup(output_filename);
+    if (output_copy) {
+        char* output_dir = dirname(output_copy);
+        struct stat st = {0};
+        if (stat(output_dir, &st) == -1) {
+            progress(args, "Directory '%s' does not exist, will create it\n", output_dir);
+            mkdir(output_dir, 0700);
+        }
+        free(output_copy);
+    }
+    return output_filename;
+}
+
+// Name a rewritten output is written under until it is complete. It sits next to the
+// output so the rename that replaces it stays within one filesystem
+static char* temporary_output(const char* output_filename) {
+    size_t size = strlen(output_filename) + 32;
+    char* temporary = malloc(size);
+    if (temporary) snprintf(temporary, size, "%s.%ld.tmp", output_filename, (long)getpid());
+    return temporary;
+}
+
+// Moves a finished temporary output over the real one, a failed one is removed and
+// whatever the output held before is left alone. Returns result, or -1 if the rename fails
+static int finish_output(const char* temporary, const char* output_filename, int result) {
+    if (result == 0 && rename(temporary, output_filename) != 0) result = -1;
+    if (result != 0) unlink(temporary);
+    return result;
+}
+
+// Converts a CSV log straight to the output file without loading it, memory use is
+// bounded by the --memory_budget. 0 = good, -1 = bad
+static int stream_log_file(const GeneratorArgs* args) {
+    progress(args, "Streaming log...\n");
+
+    MappedFile input;
+    if (mapped_file_open(&input, args->log_path, !args->no_mmap, MAPPED_ACCESS_SEQUENTIAL) != 0) {
+        printf("ERROR: Cannot open log file: %s\n", args->log_path);
+        return -1;
     }
 
-    printf("Saving MoTeC log...\n");
-    result = motec_log_write(motec_log, output_filename);
+    MotecLog* motec_log = create_motec_log(args);
+    char* output_filename = prepare_output(args);
+    char* temporary = output_filename ? temporary_output(output_filename) : NULL;
+    if (!motec_log || !temporary) {
+        motec_log_free(motec_log);
+        free(output_filename);
+        mapped_file_close(&input);
+        return -1;
+    }
+
+    StreamOptions options;
+    options.frequency = args->frequency;
+    options.method = args->interpolation;
+    options.memory_budget = (size_t)args->memory_budget << 20;
+
+    if (args->frequency > 0) {
+        progress(args, "Resampling to %.1f Hz...\n", args->frequency);
+    }
 
+    STATS_ADD(STAT_BYTES_READ, input.size);
+    STATS_START(stream_timer);
+    int result = motec_stream_csv(motec_log, &input, temporary, &options);
+    result = finish_output(temporary, output_filename, result);
+    STATS_STOP(STAT_STAGE_STREAM, stream_timer);
+    if (result != 0) {
+        printf("ERROR: Failed to convert log\n");
+    } else {
+        progress(args, "Wrote %zu channels\n", motec_log->channel_count);
+        progress(args, "Done!\n");
+    }
+
+    free(temporary);
     free(output_filename);
-    free(output_dir);
     motec_log_free(motec_log);
+    mapped_file_close(&input);
+    return result;
+}
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static volatile sig_atomic_t follow_stopped;
+
+static void stop_following(int signal_number) {
+    (void)signal_number;
+    follow_stopped = 1;
+}
+
+// Extends the output with the rows parsed so far, resampling a copy so the followed log
+// keeps its original samples. 0 = good, -1 = bad
+static int publish_followed_log(const GeneratorArgs* args, DataLog* data_log, const char* output_filename) {
+    DataLog* published = data_log;
+    if (args->frequency > 0) {
+        published = datalog_snapshot(data_log);
+        if (!published) return -1;
+
+        STATS_START(resample_timer);
+        int result = datalog_resample_with(published, args->frequency, args->interpolation, args->threads);
+        STATS_STOP(STAT_STAGE_RESAMPLE, resample_timer);
+        if (result != 0) {
+            datalog_free(published);
+            return -1;
+        }
+    }
+
+    int result = -1;
+    MotecLog* motec_log = create_motec_log(args);
+    if (motec_log) {
+        STATS_START(write_timer);
+        result = motec_log_append(motec_log, published, output_filename);
+        STATS_STOP(STAT_STAGE_WRITE, write_timer);
+    }
+    motec_log_free(motec_log);
+    if (published != data_log) datalog_free(published);
+    return result;
+}
+
+// Parses whatever was appended to the log since offset, 0 = good, -1 = bad
+static int read_followed_log(int fd, CsvFollow* follow, char* buffer, off_t* offset) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    if (st.st_size < *offset) {
+        printf("ERROR: Log was truncated while following it\n");
+        return -1;
+    }
+
+    while (*offset < st.st_size) {
+        ssize_t n = pread(fd, buffer, FOLLOW_READ_SIZE, *offset);
+        if (n <= 0) return n < 0 ? -1 : 0;
+
+        STATS_ADD(STAT_BYTES_READ, n);
+        STATS_START(load_timer);
+        int result = csv_follow_feed(follow, buffer, (size_t)n);
+        STATS_STOP(STAT_STAGE_LOAD, load_timer);
+        if (result != 0) return -1;
+        *offset += n;
+    }
+    return 0;
+}
+
+// Converts a CSV or Accessport log while it is still being written. Rows are parsed as
+// they are appended, and every --publish_interval seconds the output is extended in place
+// with them, until the log is deleted or the process is interrupted. 0 = good, -1 = bad
+static int follow_log_file(const GeneratorArgs* args) {
+    int fd = open(args->log_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("ERROR: Cannot open log file: %s\n", args->log_path);
+        return -1;
+    }
+
+    DataLog* data_log = datalog_create("");
+    char* buffer = malloc(FOLLOW_READ_SIZE);
+    char* output_filename = prepare_output(args);
+    if (!data_log || !buffer || !output_filename) {
+        datalog_free(data_log);
+        free(buffer);
+        free(output_filename);
+        close(fd);
+        return -1;
+    }
+
+    CsvFollow follow;
+    csv_follow_init(&follow, data_log, args->log_type == LOG_TYPE_ACCESSPORT ? LOG_SCHEMA_ACCESSPORT
+                                                                            : LOG_SCHEMA_CSV);
+
+    // without inotify the log is just checked every FOLLOW_POLL_MS
+    int watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd >= 0 && inotify_add_watch(watch_fd, args->log_path, IN_MODIFY | IN_ATTRIB) < 0) {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+
+    // SIGINT and SIGTERM end the loop with one last publish. They stay blocked except
+    // while ppoll sleeps, so one can't slip in between checking follow_stopped and sleeping
+    struct sigaction stop, old_int, old_term;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = stop_following;
+    sigemptyset(&stop.sa_mask);
+    follow_stopped = 0;
+    sigaction(SIGINT, &stop, &old_int);
+    sigaction(SIGTERM, &stop, &old_term);
+    sigset_t stop_signals, old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+    progress(args, "Following log, publishing every %.1fs (Ctrl-C to stop)...\n", args->publish_interval);
+
+    off_t offset = 0;
+    size_t published_rows = 0;
+    double next_publish = wall_seconds();
+    int result = 0;
+    for (;;) {
+        result = read_followed_log(fd, &follow, buffer, &offset);
+        if (result != 0) break;
+
+        struct stat st;
+        int deleted = fstat(fd, &st) == 0 && st.st_nlink == 0;
+        int done = follow_stopped || deleted;
+
+        size_t rows = follow.rows ? follow.rows->count : 0;
+        int waiting = rows > published_rows && datalog_channel_count(data_log) > 0;
+        double now = wall_seconds();
+        if (waiting && (done || now >= next_publish)) {
+            result = publish_followed_log(args, data_log, output_filename);
+            if (result != 0) {
+                printf("ERROR: Failed to write MoTeC log\n");
+                break;
+            }
+            published_rows = rows;
+            progress(args, "Published %zu rows, %.1fs of log\n", rows, datalog_duration(data_log));
+            next_publish = now + args->publish_interval;
+            waiting = 0;
+        }
+        if (done) break;
+
+        // sleep until the log changes, or until the rows waiting to be published are due
+        double timeout = FOLLOW_POLL_MS / 1000.0;
+        if (watch_fd >= 0) timeout = waiting ? next_publish - now : -1;
+        struct timespec ts = { (time_t)timeout, (long)((timeout - (double)(time_t)timeout) * 1e9) };
+        struct pollfd pfd = { watch_fd, POLLIN, 0 };
+        if (ppoll(&pfd, watch_fd >= 0 ? 1 : 0, timeout >= 0 ? &ts : NULL, &old_mask) > 0) {
+            // the events only say the log changed, read_followed_log finds out what changed
+            char events[4096];
+            while (read(watch_fd, events, sizeof(events)) > 0) continue;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    if (watch_fd >= 0) close(watch_fd);
+    csv_follow_free(&follow);
     datalog_free(data_log);
+    free(output_filename);
+    free(buffer);
+    close(fd);
 
     if (result == 0) {
-        printf("Done!\n");
+        progress(args, "Done!\n");
     }
     return result;
 }
 
+// Converts one log, batch is NULL outside of --batch. 0 = good, -1 = bad
+static int convert_log(const GeneratorArgs* args, BatchShared* batch) {
+    if (args->stream) {
+        return stream_log_file(args);
+    }
+    if (args->follow) {
+        return follow_log_file(args);
+    }
+
+    progress(args, "Loading log...\n");
+
+    DataLog* data_log = datalog_create(""); 
+    if (!data_log) {
+        return -1;
+    }
+
+    STATS_START(load_timer);
+    int result = load_log(args, data_log, batch);
+    STATS_STOP(STAT_STAGE_LOAD, load_timer);
+
+    if (result != 0 || datalog_channel_count(data_log) == 0) {
+        printf("ERROR: Failed to find any channels in log data\n");
+        // printf("Found %d channels in data_log\n", datalog_channel_count(data_log)); // Debug
+        datalog_free(data_log);
+        return -1;
+    }
+
+    if (!args->quiet) {
+        printf("Parsed %.1fs log with %d channels:\n",
+           datalog_duration(data_log),  
+           datalog_channel_count(data_log));
+
+        data_log_print_channels(data_log);
+    }
+
+    if (args->frequency > 0) {
+        progress(args, "Resampling to %.1f Hz...\n", args->frequency);
+        STATS_START(resample_timer);
+        result = datalog_resample_with(data_log, args->frequency, args->interpolation, args->threads);
+        STATS_STOP(STAT_STAGE_RESAMPLE, resample_timer);
+        if (result != 0) {
+            printf("ERROR: Failed to resample log\n");
+            datalog_free(data_log);
+            return -1;
+        }
+    }
+
+    progress(args, "Converting to MoTeC log...\n");
+    STATS_START(convert_timer);
+    MotecLog* motec_log = create_motec_log(args);
+    if (!motec_log) {
+        datalog_free(data_log);
+        return -1;
+    }
+
+    // --append encodes the channels itself, against what the existing file holds
+    result = args->append ? 0 : motec_log_add_all_channels(motec_log, data_log);
+    STATS_STOP(STAT_STAGE_CONVERT, convert_timer);
+    if (result != 0) {
+        // a partly converted log would be written with channels silently missing
+        printf("ERROR: Failed to convert log\n");
+        motec_log_free(motec_log);
+        datalog_free(data_log);
+        return -1;
+    }
+
+    char* output_filename = prepare_output(args);
+    if (!output_filename) {
+        motec_log_free(motec_log);
+        datalog_free(data_log);
+        return -1;
+    }
+
+    progress(args, "Saving MoTeC log...\n");
+    // the output is mapped and filled in parallel where possible, stdio handles the rest (pipes, --no_mmap).
+    // A rewrite goes to a temporary file first so a failure keeps the previous output, --append
+    // extends the existing file in place and writes its header last
+    STATS_START(write_timer);
+    result = -1;
+    if (args->append) {
+        result = motec_log_append(motec_log, data_log, output_filename);
+    } else {
+        char* temporary = temporary_output(output_filename);
+        if (temporary && !args->no_mmap) {
+            result = motec_log_write_mapped(motec_log, temporary, args->threads);
+        }
+        if (temporary && result != 0) {
+            result = motec_log_write(motec_log, temporary);
+        }
+        if (temporary) result = finish_output(temporary, output_filename, result);
+        free(temporary);
+    }
+    STATS_STOP(STAT_STAGE_WRITE, write_timer);
+    if (result != 0) {
+        printf("ERROR: Failed to write %s\n", output_filename);
+    }
+
+    free(output_filename);
+    motec_log_free(motec_log);
+    datalog_free(data_log);
+
+    if (result == 0) {
+        progress(args, "Done!\n");
+    }
+    return result;
+}
+
+int process_log_file(const GeneratorArgs* args) {
+    return convert_log(args, NULL);
+}
+
+// One log of a --batch run
+typedef struct BatchJob {
+    char* log_path;
+    char* output_path; // the log's name under the --output directory, NULL = next to the log
+    char* output_filename;
+    size_t size;
+    int result;
+    double seconds;
+} BatchJob;
+
+// Memory the running jobs may use between them, a job waits until its estimate fits
+typedef struct MemoryBudget {
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+    size_t total;
+    size_t available;
+} MemoryBudget;
+
+typedef struct BatchRun {
+    const GeneratorArgs* args;
+    BatchJob* jobs;
+    size_t job_count;
+    size_t job_capacity;
+    size_t finished;
+    pthread_mutex_t print_lock;
+    MemoryBudget memory;
+    BatchShared shared;
+} BatchRun;
+
+// Takes size bytes of the budget, waiting for running jobs to release them. A job bigger
+// than the whole budget takes all of it and runs alone. Returns the amount taken
+static size_t memory_budget_acquire(MemoryBudget* budget, size_t size) {
+    if (size > budget->total) size = budget->total;
+    pthread_mutex_lock(&budget->lock);
+    while (budget->available < size) {
+        pthread_cond_wait(&budget->released, &budget->lock);
+    }
+    budget->available -= size;
+    pthread_mutex_unlock(&budget->lock);
+    return size;
+}
+
+static void memory_budget_release(MemoryBudget* budget, size_t size) {
+    pthread_mutex_lock(&budget->lock);
+    budget->available += size;
+    pthread_cond_broadcast(&budget->released);
+    pthread_mutex_unlock(&budget->lock);
+}
+
+// --batch_memory, half of physical memory by default
+static size_t batch_memory_total(const GeneratorArgs* args) {
+    if (args->batch_memory > 0) return (size_t)args->batch_memory << 20;
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) return SIZE_MAX;
+    return (size_t)pages * (size_t)page_size / 2;
+}
+
+// Rough peak memory of converting a log of input_size bytes
+static size_t job_memory(const GeneratorArgs* args, size_t input_size) {
+    if (args->stream) return (size_t)args->memory_budget << 20;
+    return input_size * BATCH_MEMORY_FACTOR;
+}
+
+static int add_batch_job(BatchRun* run, const char* log_path) {
+    if (run->job_count >= run->job_capacity) {
+        size_t capacity = run->job_capacity ? run->job_capacity * 2 : 64;
+        BatchJob* jobs = realloc(run->jobs, capacity * sizeof(BatchJob));
+        if (!jobs) return -1;
+        run->jobs = jobs;
+        run->job_capacity = capacity;
+    }
+
+    BatchJob* job = &run->jobs[run->job_count];
+    memset(job, 0, sizeof(BatchJob));
+    job->log_path = strdup(log_path);
+    if (!job->log_path) return -1;
+
+    struct stat st;
+    if (stat(log_path, &st) == 0) job->size = (size_t)st.st_size;
+    run->job_count++;
+    return 0;
+}
+
+static int is_regular_file(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Every .csv file in the directory, .log files for CAN
+static int collect_directory(BatchRun* run, const char* dir_path) {
+    struct dirent** entries;
+    int count = scandir(dir_path, &entries, NULL, alphasort);
+    if (count < 0) {
+        printf("ERROR: Cannot read directory: %s\n", dir_path);
+        return -1;
+    }
+
+    const char* extension = run->args->log_type == LOG_TYPE_CAN ? ".log" : ".csv";
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        const char* ext = strrchr(entries[i]->d_name, '.');
+        if (result == 0 && ext && strcasecmp(ext, extension) == 0) {
+            char* path = malloc(strlen(dir_path) + strlen(entries[i]->d_name) + 2);
+            if (!path) {
+                result = -1;
+            } else {
+                sprintf(path, "%s/%s", dir_path, entries[i]->d_name);
+                if (is_regular_file(path)) result = add_batch_job(run, path);
+                free(path);
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return result;
+}
+
+static int collect_glob(BatchRun* run, const char* pattern) {
+    glob_t matches;
+    if (glob(pattern, 0, NULL, &matches) != 0) {
+        printf("ERROR: No files match: %s\n", pattern);
+        return -1;
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < matches.gl_pathc && result == 0; i++) {
+        if (is_regular_file(matches.gl_pathv[i])) result = add_batch_job(run, matches.gl_pathv[i]);
+    }
+    globfree(&matches);
+    return result;
+}
+
+// One log path per line, blank lines and lines starting with '#' are skipped
+static int collect_list(BatchRun* run, const char* list_path) {
+    FILE* f = fopen(list_path, "r");
+    if (!f) {
+        printf("ERROR: Cannot open log list: %s\n", list_path);
+        return -1;
+    }
+
+    int result = 0;
+    char* line = NULL;
+    size_t line_size = 0;
+    while (result == 0 && getline(&line, &line_size, f) != -1) {
+        char* path = line;
+        while (isspace((unsigned char)*path)) path++;
+        size_t len = strlen(path);
+        while (len > 0 && isspace((unsigned char)path[len - 1])) path[--len] = '\0';
+        if (len > 0 && path[0] != '#') result = add_batch_job(run, path);
+    }
+    free(line);
+    fclose(f);
+    return result;
+}
+
+// The <log> argument of --batch: a glob pattern, a directory or a file listing logs
+static int collect_batch_inputs(BatchRun* run, const char* source) {
+    if (strpbrk(source, "*?[")) return collect_glob(run, source);
+
+    struct stat st;
+    if (stat(source, &st) != 0) {
+        printf("ERROR: Cannot open batch input: %s\n", source);
+        return -1;
+    }
+    return S_ISDIR(st.st_mode) ? collect_directory(run, source) : collect_list(run, source);
+}
+
+static int compare_output_filenames(const void* a, const void* b) {
+    const BatchJob* ja = *(const BatchJob* const*)a;
+    const BatchJob* jb = *(const BatchJob* const*)b;
+    return strcmp(ja->output_filename, jb->output_filename);
+}
+
+// Largest logs first, so the long jobs don't end up running alone at the end
+static int compare_job_sizes(const void* a, const void* b) {
+    const BatchJob* ja = a;
+    const BatchJob* jb = b;
+    if (ja->size != jb->size) return ja->size < jb->size ? 1 : -1;
+    return strcmp(ja->log_path, jb->log_path);
+}
+
+// Works out every job's output file and refuses to let two jobs write the same one
+static int prepare_batch_jobs(BatchRun* run) {
+    const char* output_dir = run->args->output_path;
+    for (size_t i = 0; i < run->job_count; i++) {
+        BatchJob* job = &run->jobs[i];
+        if (output_dir) {
+            const char* slash = strrchr(job->log_path, '/');
+            const char* name = slash ? slash + 1 : job->log_path;
+            job->output_path = malloc(strlen(output_dir) + strlen(name) + 2);
+            if (!job->output_path) return -1;
+            sprintf(job->output_path, "%s/%s", output_dir, name);
+        }
+        job->output_filename = get_output_filename(job->log_path, job->output_path);
+        if (!job->output_filename) return -1;
+    }
+
+    BatchJob** sorted = malloc(run->job_count * sizeof(BatchJob*));
+    if (!sorted) return -1;
+    for (size_t i = 0; i < run->job_count; i++) sorted[i] = &run->jobs[i];
+    qsort(sorted, run->job_count, sizeof(BatchJob*), compare_output_filenames);
+
+    int result = 0;
+    for (size_t i = 1; i < run->job_count && result == 0; i++) {
+        if (strcmp(sorted[i - 1]->output_filename, sorted[i]->output_filename) == 0) {
+            printf("ERROR: %s and %s would both be written to %s\n",
+                   sorted[i - 1]->log_path, sorted[i]->log_path, sorted[i]->output_filename);
+            result = -1;
+        }
+    }
+    free(sorted);
+
+    qsort(run->jobs, run->job_count, sizeof(BatchJob), compare_job_sizes);
+    return result;
+}
+
+// Converts one log of the batch. A failing job is recorded and doesn't stop the others
+static void run_batch_job(void* context, size_t index) {
+    BatchRun* run = context;
+    BatchJob* job = &run->jobs[index];
+
+    GeneratorArgs args = *run->args;
+    args.log_path = job->log_path;
+    args.output_path = job->output_path;
+    args.quiet = 1;
+
+    size_t reserved = memory_budget_acquire(&run->memory, job_memory(&args, job->size));
+
+    double start = wall_seconds();
+    job->result = convert_log(&args, &run->shared);
+    job->seconds = wall_seconds() - start;
+
+    memory_budget_release(&run->memory, reserved);
+
+    pthread_mutex_lock(&run->print_lock);
+    run->finished++;
+    printf("[%zu/%zu] %s %s (%.1fs)\n", run->finished, run->job_count,
+           job->result == 0 ? "Converted" : "FAILED", job->log_path, job->seconds);
+    pthread_mutex_unlock(&run->print_lock);
+}
+
+static void free_batch(BatchRun* run) {
+    for (size_t i = 0; i < run->job_count; i++) {
+        free(run->jobs[i].log_path);
+        free(run->jobs[i].output_path);
+        free(run->jobs[i].output_filename);
+    }
+    free(run->jobs);
+    for (size_t i = 0; i < run->shared.schema_count; i++) {
+        log_schema_free(run->shared.schemas[i]);
+    }
+    free(run->shared.schemas);
+    dbc_plan_free(run->shared.dbc_plan);
+    pthread_mutex_destroy(&run->shared.schema_lock);
+    pthread_mutex_destroy(&run->print_lock);
+    pthread_mutex_destroy(&run->memory.lock);
+    pthread_cond_destroy(&run->memory.released);
+}
+
+// Converts every log named by a --batch <log> argument on --jobs workers. 0 = every log
+// converted, -1 = at least one failed
+int process_batch(const GeneratorArgs* args) {
+    BatchRun run;
+    memset(&run, 0, sizeof(run));
+    run.args = args;
+    pthread_mutex_init(&run.print_lock, NULL);
+    pthread_mutex_init(&run.shared.schema_lock, NULL);
+    pthread_mutex_init(&run.memory.lock, NULL);
+    pthread_cond_init(&run.memory.released, NULL);
+    run.memory.total = batch_memory_total(args);
+    run.memory.available = run.memory.total;
+
+    int result = collect_batch_inputs(&run, args->log_path);
+    if (result == 0 && run.job_count == 0) {
+        printf("ERROR: No logs found in: %s\n", args->log_path);
+        result = -1;
+    }
+
+    if (result == 0 && args->output_path) {
+        struct stat st;
+        if (stat(args->output_path, &st) == -1 && mkdir(args->output_path, 0700) != 0) {
+            printf("ERROR: Cannot create output directory: %s\n", args->output_path);
+            result = -1;
+        }
+    }
+    if (result == 0) result = prepare_batch_jobs(&run);
+
+    if (result == 0 && args->log_type == LOG_TYPE_CAN) {
+        printf("Loading DBC...\n");
+        run.shared.dbc_plan = dbc_plan_load(args->dbc_path);
+        if (!run.shared.dbc_plan) {
+            printf("ERROR: Cannot load DBC file: %s\n", args->dbc_path);
+            result = -1;
+        }
+    }
+
+    if (result == 0) {
+        printf("Converting %zu logs, %d at a time...\n", run.job_count, args->jobs);
+        double start = wall_seconds();
+        parallel_for(run.job_count, args->jobs, run_batch_job, &run);
+        double seconds = wall_seconds() - start;
+
+        size_t failed = 0;
+        size_t bytes = 0;
+        for (size_t i = 0; i < run.job_count; i++) {
+            if (run.jobs[i].result != 0) {
+                failed++;
+            } else {
+                bytes += run.jobs[i].size;
+            }
+        }
+        printf("Converted %zu of %zu logs (%.1f MB) in %.1fs\n",
+               run.job_count - failed, run.job_count, (double)bytes / (1 << 20), seconds);
+        if (failed > 0) {
+            printf("Failed logs:\n");
+            for (size_t i = 0; i < run.job_count; i++) {
+                if (run.jobs[i].result != 0) printf("  %s\n", run.jobs[i].log_path);
+            }
+            result = -1;
+        }
+    }
+
+    free_batch(&run);
+    return result;
+}
+
 void print_usage(void) {
     printf("%s\n\n", DESCRIPTION);
     printf("Usage: motec_log_generator <log> <log_type> [options]\n");
+    printf("       motec_log_generator --batch <dir|glob|list> <log_type> [options]\n");
     printf("Log types: CAN, CSV, ACCESSPORT\n\n");
     printf("Options:\n");
     printf("  --output <file>        Output filename\n");
-    printf("  --frequency <hz>       Fixed frequency to resample channels\n");
+    printf("  --frequency <hz>       Fixed frequency to resample channels, 0 = keep original samples\n");
+    printf("  --interpolation <m>    Resampling method: linear (default) or hold\n");
     printf("  --dbc <file>          DBC file (required for CAN logs)\n");
     printf("  --driver <str>         Driver name\n");
     printf("  --vehicle_id <str>     Vehicle ID\n");
@@ -221,7 +1085,19 @@ void print_usage(void) {
     printf("  --event_name <str>     Event name\n");
     printf("  --event_session <str>  Event session\n");
     printf("  --long_comment <str>   Long comment\n");
-    printf("  --short_comment <str>  Short comment\n\n");
+    printf("  --short_comment <str>  Short comment\n");
+    printf("  --no_mmap              Use buffered reads and writes instead of mapping the log and output\n");
+    printf("  --threads <n>          Parse with n threads, 0 = one per CPU (default 1)\n");
+    printf("  --stream               Convert a CSV log in two passes without loading it into memory\n");
+    printf("  --memory_budget <mb>   Output buffered by --stream before it is written (default 64)\n");
+    printf("  --batch                Convert every log in a directory (*.csv, *.log for CAN), matching a\n");
+    printf("                         quoted glob, or listed one per line in a file. --output is a directory\n");
+    printf("  --jobs <n>             Logs converted at once by --batch, 0 = one per CPU (default 0)\n");
+    printf("  --batch_memory <mb>    Memory --batch jobs may use between them (default half of RAM)\n");
+    printf("  --append               Extend the existing .ld output in place, writing only samples that changed\n");
+    printf("  --follow               Keep converting a CSV or Accessport log as it is written, until Ctrl-C\n");
+    printf("  --publish_interval <s> How often --follow extends the output with new rows (default 2)\n");
+    printf("  --stats[=json]         Print stage timings and counters when done, as text or JSON\n\n");
     printf("%s\n", EPILOG);
 }
 
@@ -246,7 +1122,9 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    int result = process_log_file(&args);
+    int result = args.batch ? process_batch(&args) : process_log_file(&args);
+    if (args.stats == STATS_REPORT_TEXT) stats_print(stdout);
+    if (args.stats == STATS_REPORT_JSON) stats_print_json(stdout);
     free_arguments(&args);
     return result;
 }
\ No newline at end of file
@@ -13,12 +13,32 @@ typedef enum {
     LOG_TYPE_ACCESSPORT
 } LogType;
 
+// What --stats prints once the conversion is done
+typedef enum {
+    STATS_REPORT_NONE,
+    STATS_REPORT_TEXT,
+    STATS_REPORT_JSON
+} StatsReport;
+
 typedef struct {
     char* log_path;
     LogType log_type;
     char* output_path;
-    float frequency;
+    float frequency; // resample every channel to this rate, 0 keeps the original samples
+    ResampleMethod interpolation;
     char* dbc_path;
+    int no_mmap; // read the input with buffered reads instead of mapping it
+    int threads; // worker threads for parsing, 0 = one per CPU
+    int stream; // convert in two passes without loading the whole log
+    int memory_budget; // MB of output buffered while streaming
+    int batch; // log_path names many logs: a directory, a glob or a list file
+    int jobs; // logs converted at once in batch mode
+    int batch_memory; // MB the batch jobs may use between them, 0 = half of physical memory
+    int quiet; // only errors are printed, set for the jobs of a batch
+    int append; // extend an existing .ld output instead of rewriting it
+    int follow; // keep converting the log as it is written, publishing every publish_interval
+    float publish_interval; // seconds between --follow updates of the output
+    StatsReport stats;
     
     char* driver;
     char* vehicle_id;
@@ -35,6 +55,7 @@ typedef struct {
 int parse_arguments(int argc, char** argv, GeneratorArgs* args);
 char* get_output_filename(const char* input_path, const char* output_path);
 int process_log_file(const GeneratorArgs* args);
+int process_batch(const GeneratorArgs* args);
 void print_usage(void);
 void free_arguments(GeneratorArgs* args);
 
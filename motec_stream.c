@@ -0,0 +1,310 @@
+#include "motec_stream.h"
+#include "csv_index.h"
+#include "stats.h"
+#include <unistd.h>
+
+#define MIN_BUFFER_SAMPLES 256
+#define DISCARD_INTERVAL ((size_t)8 << 20) // input bytes parsed between dropping mapped pages
+
+// One CSV column on its way to the .ld file
+typedef struct StreamChannel {
+    char* name;
+    char* units;
+
+    // first pass
+    size_t total;
+    double first;
+    double last;
+
+    // second pass
+    ldChan* ld;
+    size_t seen;       // samples received so far
+    double t0;         // previous sample, the left end of the current resampling segment
+    double v0;
+    size_t next_grid;  // next grid point to fill
+    float* buffer;
+    size_t buffered;
+    size_t written;    // samples already in the file
+} StreamChannel;
+
+typedef struct CsvStream {
+    const MappedFile* input;
+    size_t body; // offset of the first data row
+    StreamChannel* channels;
+    size_t channel_count;
+
+    size_t row_count;
+    double first_row;
+    double last_row;
+
+    int resample;
+    double frequency;
+    ResampleMethod method;
+    double start;
+    size_t grid_count;
+
+    int fd;
+    size_t buffer_samples;
+    int failed;
+} CsvStream;
+
+// Reads the header and units rows into stream->channels, 0 = good, -1 = bad
+static int read_stream_header(CsvStream* stream) {
+    CsvScanner scanner;
+    if (csv_scanner_init(&scanner, stream->input->data, stream->input->size) != 0) return -1;
+
+    size_t header_count = 0;
+    size_t unit_count = 0;
+    CsvField* header = NULL;
+    if (csv_scanner_next_row(&scanner, &header_count)) {
+        header = malloc(sizeof(CsvField) * header_count);
+        if (header) memcpy(header, scanner.fields, sizeof(CsvField) * header_count);
+    }
+    if (!header || !csv_scanner_next_row(&scanner, &unit_count)) {
+        free(header);
+        csv_scanner_free(&scanner);
+        return -1;
+    }
+
+    // same rule as datalog_from_csv_buffer: every column after the first with a name and a unit
+    size_t count = header_count < unit_count ? header_count : unit_count;
+    stream->channels = calloc(count, sizeof(StreamChannel));
+    for (size_t column = 1; stream->channels && column < count; column++) {
+        StreamChannel* channel = &stream->channels[stream->channel_count];
+        channel->name = csv_field_dup(&header[column]);
+        channel->units = csv_field_dup(&scanner.fields[column]);
+        if (channel->name && channel->units) {
+            stream->channel_count++;
+        } else {
+            free(channel->name);
+            free(channel->units);
+            channel->name = channel->units = NULL;
+        }
+    }
+
+    stream->body = csv_scanner_offset(&scanner);
+    free(header);
+    csv_scanner_free(&scanner);
+    return stream->channels ? 0 : -1;
+}
+
+// Parses every data row, calling visit for each numeric cell. Mapped pages are
+// dropped behind the cursor so the input never has to fit in memory
+static int scan_stream_rows(CsvStream* stream,
+                            void (*visit)(CsvStream*, StreamChannel*, double, double),
+                            int count_rows) {
+    const MappedFile* input = stream->input;
+    CsvScanner scanner;
+    if (csv_scanner_init(&scanner, input->data + stream->body, input->size - stream->body) != 0) return -1;
+
+    size_t discarded = 0;
+    size_t field_count;
+    while (csv_scanner_next_row(&scanner, &field_count) && !stream->failed) {
+        const CsvField* fields = scanner.fields;
+
+        double timestamp;
+        if (!csv_field_parse_number(fields[0], &timestamp)) continue;
+
+        if (count_rows) {
+            if (stream->row_count == 0) stream->first_row = timestamp;
+            stream->last_row = timestamp;
+            stream->row_count++;
+        }
+
+        size_t cells = field_count - 1 < stream->channel_count ? field_count - 1 : stream->channel_count;
+        for (size_t i = 0; i < cells; i++) {
+            double value;
+            if (csv_field_parse_number(fields[i + 1], &value)) {
+                visit(stream, &stream->channels[i], timestamp, value);
+            }
+        }
+
+        size_t offset = stream->body + csv_scanner_offset(&scanner);
+        if (offset - discarded >= DISCARD_INTERVAL) {
+            mapped_file_discard(input, offset);
+            discarded = offset;
+        }
+    }
+
+    csv_scanner_free(&scanner);
+    mapped_file_discard(input, input->size);
+    return stream->failed ? -1 : 0;
+}
+
+// First pass visitor, only the sample count and time range are needed to size the regions
+static void count_sample(CsvStream* stream, StreamChannel* channel, double timestamp, double value) {
+    (void)stream;
+    (void)value;
+    if (channel->total == 0) channel->first = timestamp;
+    channel->last = timestamp;
+    channel->total++;
+}
+
+// Writes a channel's buffered samples to their place in its data region
+static void flush_channel(CsvStream* stream, StreamChannel* channel) {
+    if (channel->buffered == 0) return;
+
+    if (channel->written + channel->buffered > channel->ld->data_len) {
+        stream->failed = 1; // the input changed between the two passes
+        return;
+    }
+
+    const char* p = (const char*)channel->buffer;
+    size_t bytes = channel->buffered * sizeof(float);
+    off_t offset = (off_t)channel->ld->data_ptr + (off_t)(channel->written * sizeof(float));
+    while (bytes > 0) {
+        ssize_t n = pwrite(stream->fd, p, bytes, offset);
+        if (n <= 0) {
+            stream->failed = 1;
+            return;
+        }
+        p += n;
+        bytes -= (size_t)n;
+        offset += n;
+    }
+
+    STATS_ADD(STAT_BYTES_WRITTEN, channel->buffered * sizeof(float));
+    channel->written += channel->buffered;
+    channel->buffered = 0;
+}
+
+static void emit_sample(CsvStream* stream, StreamChannel* channel, double value) {
+    channel->buffer[channel->buffered++] = (float)value;
+    if (channel->buffered == stream->buffer_samples) flush_channel(stream, channel);
+}
+
+// Second pass. Resampling walks the grid exactly like datalog_resample_with: grid
+// points before this sample are interpolated on the segment it closes, and the
+// last sample of a channel closes every grid point that is left
+static void convert_sample(CsvStream* stream, StreamChannel* channel, double timestamp, double value) {
+    if (!stream->resample) {
+        emit_sample(stream, channel, value);
+        return;
+    }
+
+    int last = channel->seen + 1 == channel->total;
+    if (channel->total == 1) {
+        for (; channel->next_grid < stream->grid_count; channel->next_grid++) {
+            emit_sample(stream, channel, value);
+        }
+    } else if (channel->seen > 0) {
+        for (; channel->next_grid < stream->grid_count; channel->next_grid++) {
+            double t = resample_grid_time(stream->start, stream->frequency, channel->next_grid);
+            if (!last && t >= timestamp) break;
+            emit_sample(stream, channel, resample_interpolate(channel->t0, channel->v0, timestamp, value,
+                                                              t, stream->method));
+        }
+    }
+
+    channel->t0 = timestamp;
+    channel->v0 = value;
+    channel->seen++;
+}
+
+// Creates the .ld channel records from the first pass counts, they are placed in the
+// file when the metadata is written. 0 = good, -1 = bad
+static int plan_stream_layout(CsvStream* stream, MotecLog* log) {
+    if (stream->resample) {
+        double start = 0.0, end = 0.0;
+        int seen = 0;
+        for (size_t i = 0; i < stream->channel_count; i++) {
+            StreamChannel* channel = &stream->channels[i];
+            if (channel->total == 0) continue;
+            if (!seen || channel->first < start) start = channel->first;
+            if (!seen || channel->last > end) end = channel->last;
+            seen = 1;
+        }
+        stream->start = start;
+        stream->grid_count = resample_grid_count(start, end, stream->frequency);
+        if (stream->grid_count == 0) return -1;
+    }
+
+    double duration = stream->last_row - stream->first_row;
+    for (size_t i = 0; i < stream->channel_count; i++) {
+        StreamChannel* channel = &stream->channels[i];
+
+        size_t data_len = channel->total;
+        double frequency = 0.0;
+        if (stream->resample) {
+            if (channel->total > 0) {
+                data_len = stream->grid_count;
+                frequency = stream->frequency;
+            }
+        } else if (duration > 0 && channel->total > 1) {
+            frequency = (channel->total - 1) / duration;
+        }
+
+        channel->ld = motec_log_new_channel(log, channel->name, channel->units, (uint32_t)data_len, frequency);
+        if (!channel->ld) return -1;
+    }
+    return 0;
+}
+
+static void free_stream(CsvStream* stream) {
+    for (size_t i = 0; i < stream->channel_count; i++) {
+        free(stream->channels[i].name);
+        free(stream->channels[i].units);
+        free(stream->channels[i].buffer);
+    }
+    free(stream->channels);
+}
+
+// Converts a CSV log to filename without holding its samples in memory. A first pass
+// counts each channel's samples so every data region can be placed up front, the
+// second pass converts rows and writes them straight to their final offsets. Memory
+// is bounded by options->memory_budget plus a small per channel overhead. 0 = good, -1 = bad
+int motec_stream_csv(MotecLog* log, const MappedFile* input, const char* filename,
+                     const StreamOptions* options) {
+    if (!log || !input || !filename || !options) return -1;
+
+    CsvStream stream;
+    memset(&stream, 0, sizeof(CsvStream));
+    stream.input = input;
+    stream.resample = options->frequency > 0.0;
+    stream.frequency = options->frequency;
+    stream.method = options->method;
+    stream.fd = -1;
+
+    if (read_stream_header(&stream) != 0 || stream.channel_count == 0 ||
+        scan_stream_rows(&stream, count_sample, 1) != 0 ||
+        plan_stream_layout(&stream, log) != 0) {
+        free_stream(&stream);
+        return -1;
+    }
+
+    STATS_ADD(STAT_ROWS, stream.row_count);
+    for (size_t i = 0; i < stream.channel_count; i++) STATS_ADD(STAT_CELLS, stream.channels[i].total);
+
+    stream.buffer_samples = options->memory_budget / (stream.channel_count * sizeof(float));
+    if (stream.buffer_samples < MIN_BUFFER_SAMPLES) stream.buffer_samples = MIN_BUFFER_SAMPLES;
+    for (size_t i = 0; i < stream.channel_count; i++) {
+        stream.channels[i].buffer = malloc(stream.buffer_samples * sizeof(float));
+        if (!stream.channels[i].buffer) {
+            free_stream(&stream);
+            return -1;
+        }
+    }
+
+    FILE* f = fopen(filename, "wb");
+    if (!f) {
+        free_stream(&stream);
+        return -1;
+    }
+    if (motec_log_write_metadata(log, f) != 0) {
+        fclose(f);
+        free_stream(&stream);
+        return -1;
+    }
+    fflush(f);
+    stream.fd = fileno(f);
+
+    int result = scan_stream_rows(&stream, convert_sample, 0);
+    for (size_t i = 0; i < stream.channel_count && result == 0; i++) {
+        flush_channel(&stream, &stream.channels[i]);
+        if (stream.failed || stream.channels[i].written != stream.channels[i].ld->data_len) result = -1;
+    }
+
+    if (fclose(f) != 0) result = -1;
+    free_stream(&stream);
+    return result;
+}
@@ -0,0 +1,18 @@
+#ifndef MOTEC_STREAM_H
+#define MOTEC_STREAM_H
+
+#include "motec_log.h"
+#include "mapped_file.h"
+
+#define DEFAULT_MEMORY_BUDGET (64u << 20)
+
+typedef struct StreamOptions {
+    double frequency;      // resample every channel to this rate, 0 keeps the original samples
+    ResampleMethod method;
+    size_t memory_budget;  // bytes of converted samples held before they are written out
+} StreamOptions;
+
+int motec_stream_csv(MotecLog* log, const MappedFile* input, const char* filename,
+                     const StreamOptions* options);
+
+#endif
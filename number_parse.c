@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include "number_parse.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <locale.h>
+#include <pthread.h>
+
+#define MAX_MANTISSA_DIGITS 19
+#define MAX_EXACT_MANTISSA ((uint64_t)1 << 53)
+#define MAX_EXACT_POWER 22
+#define SLOW_PATH_BUFFER 128
+
+// Every power of ten up to 1e22 is exact in a double
+static const double POWERS_OF_TEN[MAX_EXACT_POWER + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const uint64_t INTEGER_POWERS_OF_TEN[16] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL
+};
+
+static locale_t c_locale;
+static pthread_once_t c_locale_once = PTHREAD_ONCE_INIT;
+
+static void init_c_locale(void) {
+    c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+static int is_digit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+// Returns strlen(word) if p starts with word (any case), 0 otherwise. word is lower case
+static size_t match_word(const char* p, const char* end, const char* word) {
+    size_t len = strlen(word);
+    if ((size_t)(end - p) < len) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if ((p[i] | 0x20) != word[i]) return 0;
+    }
+    return len;
+}
+
+// Exact conversion of numbers the fast path can't represent, the text is already validated
+static double parse_slow(const char* p, size_t len) {
+    char local[SLOW_PATH_BUFFER];
+    char* text = len < sizeof(local) ? local : malloc(len + 1);
+    if (!text) return NAN;
+
+    memcpy(text, p, len);
+    text[len] = '\0';
+
+    pthread_once(&c_locale_once, init_c_locale);
+    double value = c_locale ? strtod_l(text, NULL, c_locale) : strtod(text, NULL);
+
+    if (text != local) free(text);
+    return value;
+}
+
+size_t parse_number(const char* p, const char* end, double* value) {
+    const char* start = p;
+    int negative = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    // nan and inf are spelled out rather than being an error
+    if (p < end && !is_digit(*p) && *p != '.') {
+        size_t len;
+        if ((len = match_word(p, end, "nan"))) {
+            *value = negative ? -NAN : NAN;
+        } else if ((len = match_word(p, end, "infinity")) || (len = match_word(p, end, "inf"))) {
+            *value = negative ? -INFINITY : INFINITY;
+        } else {
+            return 0;
+        }
+        return (size_t)(p + len - start);
+    }
+
+    uint64_t mantissa = 0;
+    int significant = 0; // digits held in mantissa, not counting leading zeros
+    int exponent = 0;    // power of ten that mantissa is multiplied by
+    int truncated = 0;   // a non-zero digit didn't fit in mantissa
+
+    const char* digits = p;
+    while (p < end && is_digit(*p)) {
+        if (significant < MAX_MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            if (mantissa) significant++;
+        } else {
+            exponent++;
+            if (*p != '0') truncated = 1;
+        }
+        p++;
+    }
+    size_t digit_count = (size_t)(p - digits);
+
+    if (p < end && *p == '.') {
+        p++;
+        digits = p;
+        while (p < end && is_digit(*p)) {
+            if (significant < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa) significant++;
+                exponent--;
+            } else if (*p != '0') {
+                truncated = 1;
+            }
+            p++;
+        }
+        digit_count += (size_t)(p - digits);
+    }
+
+    if (digit_count == 0) return 0;
+
+    // an 'e' without digits after it isn't part of the number, same as strtod
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int exponent_negative = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exponent_negative = *q == '-';
+            q++;
+        }
+        if (q < end && is_digit(*q)) {
+            int e = 0;
+            while (q < end && is_digit(*q)) {
+                if (e < 100000) e = e * 10 + (*q - '0');
+                q++;
+            }
+            exponent += exponent_negative ? -e : e;
+            p = q;
+        }
+    }
+
+    size_t consumed = (size_t)(p - start);
+
+    // Clinger's fast path: an exact mantissa times an exact power of ten rounds once
+    if (!truncated && mantissa <= MAX_EXACT_MANTISSA) {
+        double result = (double)mantissa;
+        int exact = 1;
+
+        if (mantissa == 0 || exponent == 0) {
+            // nothing to scale
+        } else if (exponent > 0 && exponent <= MAX_EXACT_POWER) {
+            result *= POWERS_OF_TEN[exponent];
+        } else if (exponent < 0 && exponent >= -MAX_EXACT_POWER) {
+            result /= POWERS_OF_TEN[-exponent];
+        } else if (exponent > MAX_EXACT_POWER && exponent - MAX_EXACT_POWER < 16) {
+            // move the excess power into the mantissa while it stays exact
+            uint64_t power = INTEGER_POWERS_OF_TEN[exponent - MAX_EXACT_POWER];
+            if (mantissa <= MAX_EXACT_MANTISSA / power) {
+                result = (double)(mantissa * power) * POWERS_OF_TEN[MAX_EXACT_POWER];
+            } else {
+                exact = 0;
+            }
+        } else {
+            exact = 0;
+        }
+
+        if (exact) {
+            *value = negative ? -result : result;
+            return consumed;
+        }
+    }
+
+    *value = parse_slow(start, consumed);
+    return consumed;
+}
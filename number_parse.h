@@ -0,0 +1,13 @@
+#ifndef NUMBER_PARSE_H
+#define NUMBER_PARSE_H
+
+#include <stddef.h>
+
+// Locale independent decimal to double conversion. Parses the number at the
+// start of [p, end) and returns how many bytes it used, or 0 if there is no
+// number there. Accepts an optional sign, digits with an optional '.', an
+// optional exponent, and "nan", "inf" or "infinity" in any case. The result is
+// correctly rounded.
+size_t parse_number(const char* p, const char* end, double* value);
+
+#endif
@@ -0,0 +1,53 @@
+#include "parallel.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef struct ParallelJob {
+    ParallelTask task;
+    void* context;
+    size_t task_count;
+    size_t next; // next index to hand out, updated atomically
+} ParallelJob;
+
+static void* parallel_worker(void* arg) {
+    ParallelJob* job = (ParallelJob*)arg;
+    for (;;) {
+        size_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->task_count) break;
+        job->task(job->context, index);
+    }
+    return NULL;
+}
+
+void parallel_for(size_t task_count, int thread_count, ParallelTask task, void* context) {
+    ParallelJob job = { task, context, task_count, 0 };
+
+    if (thread_count < 1) thread_count = 1;
+    if ((size_t)thread_count > task_count) thread_count = (int)task_count;
+
+    pthread_t* threads = NULL;
+    int started = 0;
+    if (thread_count > 1) {
+        threads = malloc(sizeof(pthread_t) * (thread_count - 1));
+        if (threads) {
+            while (started < thread_count - 1 &&
+                   pthread_create(&threads[started], NULL, parallel_worker, &job) == 0) {
+                started++;
+            }
+        }
+    }
+
+    parallel_worker(&job);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+// Number of online CPUs, at least 1
+int parallel_default_threads(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
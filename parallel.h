@@ -0,0 +1,16 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+// Runs task(context, i) for every i in [0, task_count) on up to thread_count
+// threads. Threads pull the next index from a shared counter, so uneven tasks
+// balance themselves. The calling thread works too, so with one thread (or if
+// no extra thread can be started) everything simply runs inline. Returns once
+// every task has finished.
+typedef void (*ParallelTask)(void* context, size_t index);
+
+void parallel_for(size_t task_count, int thread_count, ParallelTask task, void* context);
+int parallel_default_threads(void);
+
+#endif
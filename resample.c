@@ -0,0 +1,169 @@
+#include "data_log.h"
+#include "parallel.h"
+#include "stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLE_X86 1
+#endif
+
+#define RESAMPLE_BLOCK 1024 // output samples interpolated per pass over the scratch index
+
+typedef struct ResampleJob {
+    DataLog* log;
+    TimeBase* grid;
+    ResampleMethod method;
+    int failed; // set by any worker, always through __atomic_store_n
+} ResampleJob;
+
+typedef void (*interpolate_fn)(const double* timestamps, const double* values, const int32_t* segments,
+                               const double* grid, double* out, size_t count, ResampleMethod method);
+
+// out[k] from segment [segments[k], segments[k] + 1] of the source, evaluated at grid[k]
+static void interpolate_scalar(const double* timestamps, const double* values, const int32_t* segments,
+                               const double* grid, double* out, size_t count, ResampleMethod method) {
+    for (size_t k = 0; k < count; k++) {
+        int32_t j = segments[k];
+        out[k] = resample_interpolate(timestamps[j], values[j], timestamps[j + 1], values[j + 1],
+                                      grid[k], method);
+    }
+}
+
+#if defined(RESAMPLE_X86)
+// Same arithmetic as resample_interpolate four samples at a time, so results are bit identical
+__attribute__((target("avx2")))
+static void interpolate_avx2(const double* timestamps, const double* values, const int32_t* segments,
+                             const double* grid, double* out, size_t count, ResampleMethod method) {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128i j = _mm_loadu_si128((const __m128i*)(segments + k));
+        __m256d t = _mm256_loadu_pd(grid + k);
+        __m256d t1 = _mm256_i32gather_pd(timestamps + 1, j, 8);
+        __m256d v0 = _mm256_i32gather_pd(values, j, 8);
+        __m256d v1 = _mm256_i32gather_pd(values + 1, j, 8);
+        __m256d past = _mm256_cmp_pd(t, t1, _CMP_GE_OQ);
+
+        if (method == RESAMPLE_HOLD) {
+            _mm256_storeu_pd(out + k, _mm256_blendv_pd(v0, v1, past));
+            continue;
+        }
+
+        __m256d t0 = _mm256_i32gather_pd(timestamps, j, 8);
+        __m256d dt = _mm256_sub_pd(t1, t0);
+        __m256d w = _mm256_div_pd(_mm256_sub_pd(t, t0), dt);
+        w = _mm256_min_pd(_mm256_max_pd(w, zero), one);
+        __m256d w_flat = _mm256_and_pd(past, one);
+        w = _mm256_blendv_pd(w_flat, w, _mm256_cmp_pd(dt, zero, _CMP_GT_OQ));
+
+        __m256d v = _mm256_add_pd(v0, _mm256_mul_pd(_mm256_sub_pd(v1, v0), w));
+        _mm256_storeu_pd(out + k, v);
+    }
+
+    interpolate_scalar(timestamps, values, segments + k, grid + k, out + k, count - k, method);
+}
+#endif
+
+static interpolate_fn select_interpolator(void) {
+#if defined(RESAMPLE_X86)
+    if (__builtin_cpu_supports("avx2")) return interpolate_avx2;
+#endif
+    return interpolate_scalar;
+}
+
+// Rebuilds one channel on the grid. Finding each output's source segment is a
+// sequential merge walk, the interpolation itself runs over blocks of segments
+static void resample_channel_task(void* context, size_t index) {
+    ResampleJob* job = (ResampleJob*)context;
+    Channel* channel = job->log->channels[index];
+    TimeBase* grid = job->grid;
+
+    if (channel->message_count == 0) return;
+
+    double* out = channel_alloc_values(channel, grid->count);
+    if (!out) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    STATS_ADD(STAT_ALLOCATIONS, 1);
+
+    const double* timestamps = channel->time_base->timestamps;
+    const double* values = channel->values;
+    size_t count = channel->message_count;
+
+    if (count == 1) {
+        for (size_t k = 0; k < grid->count; k++) out[k] = values[0];
+    } else {
+        interpolate_fn interpolate = select_interpolator();
+        int32_t segments[RESAMPLE_BLOCK];
+        size_t j = 0;
+
+        for (size_t block = 0; block < grid->count; block += RESAMPLE_BLOCK) {
+            size_t n = grid->count - block < RESAMPLE_BLOCK ? grid->count - block : RESAMPLE_BLOCK;
+            for (size_t k = 0; k < n; k++) {
+                double t = grid->timestamps[block + k];
+                while (j + 2 < count && timestamps[j + 1] <= t) j++;
+                segments[k] = (int32_t)j;
+            }
+            interpolate(timestamps, values, segments, grid->timestamps + block, out + block, n, job->method);
+        }
+    }
+
+    channel_set_values(channel, out, grid->count);
+    channel_set_time_base(channel, grid);
+}
+
+// Number of grid points from start to end at frequency Hz, 0 if there would be too many
+size_t resample_grid_count(double start, double end, double frequency) {
+    double duration = end - start;
+    if (duration < 0.0) duration = 0.0;
+
+    // the small epsilon keeps an end that lands exactly on the grid from being lost to rounding
+    double samples = floor(duration * frequency + 1e-9) + 1.0;
+    if (samples > (double)INT32_MAX) return 0;
+    return (size_t)samples;
+}
+
+// Puts every channel on one uniform time base at frequency Hz, spanning the whole log.
+// Channels are independent, so each is one task on thread_count threads. 0 = good, -1 = bad
+int datalog_resample_with(DataLog* log, double frequency, ResampleMethod method, int thread_count) {
+    if (!log || frequency <= 0.0) return -1;
+    if (log->channel_count == 0) return 0;
+
+    double start = datalog_start(log);
+    size_t count = resample_grid_count(start, datalog_end(log), frequency);
+    if (count == 0) return -1;
+
+    TimeBase* grid = time_base_create(count);
+    if (!grid) return -1;
+
+    for (size_t k = 0; k < count; k++) {
+        grid->timestamps[k] = resample_grid_time(start, frequency, k);
+    }
+    grid->count = count;
+
+    // source segments are indexed with 32 bits for the vector gathers
+    for (size_t i = 0; i < log->channel_count; i++) {
+        if (log->channels[i]->message_count > (size_t)INT32_MAX) {
+            time_base_release(grid);
+            return -1;
+        }
+    }
+
+    ResampleJob job = { log, grid, method, 0 };
+    parallel_for(log->channel_count, thread_count, resample_channel_task, &job);
+
+    for (size_t i = 0; i < log->channel_count; i++) {
+        if (log->channels[i]->message_count > 0) log->channels[i]->frequency = frequency;
+    }
+
+    time_base_release(grid);
+    return job.failed ? -1 : 0;
+}
+
+// Linear resampling on the calling thread
+void datalog_resample(DataLog* log, double frequency) {
+    datalog_resample_with(log, frequency, RESAMPLE_LINEAR, 1);
+}
@@ -0,0 +1,58 @@
+#include "stats.h"
+#include <time.h>
+
+Stats motec_stats;
+
+static const char* STAGE_NAMES[STAT_STAGE_COUNT] = {"load", "resample", "convert", "write", "stream"};
+static const char* COUNTER_NAMES[STAT_COUNTER_COUNT] = {
+    "bytes_read", "rows", "cells", "allocations", "bytes_written"
+};
+
+uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static double stage_seconds(StatStage stage) {
+    return (double)motec_stats.stage_ns[stage] * 1e-9;
+}
+
+// MB/s of bytes over the stage's time, 0 if the stage never ran
+static double stage_rate(StatStage stage, uint64_t bytes) {
+    double seconds = stage_seconds(stage);
+    return seconds > 0 ? (double)bytes / seconds / 1e6 : 0.0;
+}
+
+void stats_print(FILE* f) {
+    const uint64_t* c = motec_stats.counters;
+    double total = 0.0;
+
+    fprintf(f, "Stats:\n");
+    for (int i = 0; i < STAT_STAGE_COUNT; i++) {
+        if (motec_stats.stage_ns[i] == 0) continue;
+        fprintf(f, "  %-14s %10.3fs\n", STAGE_NAMES[i], stage_seconds((StatStage)i));
+        total += stage_seconds((StatStage)i);
+    }
+    fprintf(f, "  %-14s %10.3fs\n", "total", total);
+    fprintf(f, "  %-14s %10.1f MB (%.1f MB/s loading)\n", "read", c[STAT_BYTES_READ] / 1e6,
+            stage_rate(STAT_STAGE_LOAD, c[STAT_BYTES_READ]));
+    fprintf(f, "  %-14s %10llu\n", "rows", (unsigned long long)c[STAT_ROWS]);
+    fprintf(f, "  %-14s %10llu\n", "cells", (unsigned long long)c[STAT_CELLS]);
+    fprintf(f, "  %-14s %10llu\n", "allocations", (unsigned long long)c[STAT_ALLOCATIONS]);
+    fprintf(f, "  %-14s %10.1f MB (%.1f MB/s writing)\n", "written", c[STAT_BYTES_WRITTEN] / 1e6,
+            stage_rate(STAT_STAGE_WRITE, c[STAT_BYTES_WRITTEN]));
+}
+
+void stats_print_json(FILE* f) {
+    fprintf(f, "{\"stages\": {");
+    for (int i = 0; i < STAT_STAGE_COUNT; i++) {
+        fprintf(f, "%s\"%s\": %.6f", i ? ", " : "", STAGE_NAMES[i], stage_seconds((StatStage)i));
+    }
+    fprintf(f, "}, \"counters\": {");
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+        fprintf(f, "%s\"%s\": %llu", i ? ", " : "", COUNTER_NAMES[i],
+                (unsigned long long)motec_stats.counters[i]);
+    }
+    fprintf(f, "}}\n");
+}
@@ -0,0 +1,55 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Stage timings and counters behind --stats. Counters are added once per chunk, batch
+// or buffer rather than per cell, and building with -DMOTEC_NO_STATS turns every macro
+// below into nothing, arguments included, so the hot loops pay nothing for them.
+
+typedef enum {
+    STAT_BYTES_READ,
+    STAT_ROWS, // CSV rows or CAN frames decoded
+    STAT_CELLS, // samples parsed into channels
+    STAT_ALLOCATIONS, // sample buffers allocated or grown
+    STAT_BYTES_WRITTEN,
+    STAT_COUNTER_COUNT
+} StatCounter;
+
+typedef enum {
+    STAT_STAGE_LOAD,
+    STAT_STAGE_RESAMPLE,
+    STAT_STAGE_CONVERT,
+    STAT_STAGE_WRITE,
+    STAT_STAGE_STREAM,
+    STAT_STAGE_COUNT
+} StatStage;
+
+// Totals of the process, summed over every thread and every job of a batch
+typedef struct Stats {
+    uint64_t counters[STAT_COUNTER_COUNT];
+    uint64_t stage_ns[STAT_STAGE_COUNT];
+} Stats;
+
+extern Stats motec_stats;
+
+uint64_t stats_now_ns(void);
+void stats_print(FILE* f);
+void stats_print_json(FILE* f);
+
+#ifndef MOTEC_NO_STATS
+#define STATS_ENABLED 1
+#define STATS_ADD(counter, n) \
+    __atomic_add_fetch(&motec_stats.counters[counter], (uint64_t)(n), __ATOMIC_RELAXED)
+#define STATS_START(timer) uint64_t timer = stats_now_ns()
+#define STATS_STOP(stage, timer) \
+    __atomic_add_fetch(&motec_stats.stage_ns[stage], stats_now_ns() - (timer), __ATOMIC_RELAXED)
+#else
+#define STATS_ENABLED 0
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_START(timer) ((void)0)
+#define STATS_STOP(stage, timer) ((void)0)
+#endif
+
+#endif